@@ -0,0 +1,243 @@
+#include "bearing_engine.h"
+#include "ident_decoder.h"
+#include "vorify.h"
+#include <iostream>
+#include <cmath>
+#include <utility>
+
+using namespace std;
+
+// Standard error of bearing, in degrees, at which a demodulator reports
+// without waiting for the rest of its interval
+const double BEARING_TARGET = 0.05;
+
+static int toHz(double frequency) {
+  return static_cast<int>(lround(frequency * 1000000.0));
+}
+
+BearingEngine::BearingEngine(int deviceIndex) : deviceIndex(deviceIndex) {
+  vor = vorCreate(&BearingEngine::onBearing, this);
+  vorSetTarget(vor, BEARING_TARGET);
+}
+
+BearingEngine::~BearingEngine() {
+  stop();
+  vorDestroy(vor);
+}
+
+bool BearingEngine::start(double frequency) {
+  if (running) {
+    return retune(frequency);
+  }
+
+  auto start = chrono::steady_clock::now();
+  {
+    lock_guard<mutex> lock(bearingsMutex);
+    tunedAt = start;
+    settledAt = nullopt;
+    tunedFrequency = frequency;
+  }
+
+  rtl = initRtl(deviceIndex, toHz(frequency), nullptr, vor);
+  if (!rtl) {
+    cerr << "Failed to initialize RTL device " << deviceIndex << '\n';
+    return false;
+  }
+  lastRetuneLatency = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+
+  setSettleCallback(rtl, &BearingEngine::onSettled, this);
+  setSampleCallback(rtl, &BearingEngine::onSample, this);
+  running = true;
+  reader = thread([this]() {
+    runRtlSample(rtl);
+  });
+  return true;
+}
+
+bool BearingEngine::retune(double frequency) {
+  if (!running) {
+    return start(frequency);
+  }
+
+  auto start = chrono::steady_clock::now();
+  {
+    lock_guard<mutex> lock(bearingsMutex);
+    tunedAt = start;
+    settledAt = nullopt;
+    tunedFrequency = frequency;
+  }
+
+  if (retuneRtl(rtl, toHz(frequency))) {
+    return false;
+  }
+  lastRetuneLatency = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+  release(exchange(chan, nullptr), channels);
+
+  // Anything still queued was measured on the previous frequency
+  lock_guard<mutex> lock(bearingsMutex);
+  bearings.clear();
+  return true;
+}
+
+bool BearingEngine::tuneWindow(double center, const vector<double>& frequencies) {
+  if (!running && !start(center)) {
+    return false;
+  }
+
+  channelizer *window = chanCreate();
+  vector<unique_ptr<Channel>> windowChannels;
+  for (double frequency : frequencies) {
+    auto channel = make_unique<Channel>(Channel{this, frequency, nullptr});
+    channel->vor = vorCreate(&BearingEngine::onChannelBearing, channel.get());
+    vorSetTarget(channel->vor, BEARING_TARGET);
+    if (chanAdd(window, toHz(frequency) - toHz(center), channel->vor) < 0) {
+      cerr << "Cannot place " << frequency << " in the window around " << center << '\n';
+      vorDestroy(channel->vor);
+      continue;
+    }
+    windowChannels.push_back(move(channel));
+  }
+
+  auto start = chrono::steady_clock::now();
+  {
+    lock_guard<mutex> lock(bearingsMutex);
+    tunedAt = start;
+    settledAt = nullopt;
+    tunedFrequency = center;
+  }
+
+  if (retuneRtlWideband(rtl, toHz(center), window)) {
+    for (auto& channel : windowChannels) {
+      vorDestroy(channel->vor);
+    }
+    chanDestroy(window);
+    return false;
+  }
+  lastRetuneLatency = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+
+  channels.swap(windowChannels);
+  release(exchange(chan, window), windowChannels);
+
+  lock_guard<mutex> lock(bearingsMutex);
+  bearings.clear();
+  return true;
+}
+
+// Frees a replaced window once the callback thread has switched away from it
+void BearingEngine::release(channelizer *window, vector<unique_ptr<Channel>>& windowChannels) {
+  if (!window) {
+    return;
+  }
+
+  while (running && retunePending(rtl)) {
+    this_thread::sleep_for(chrono::milliseconds(1));
+  }
+
+  for (auto& channel : windowChannels) {
+    vorDestroy(channel->vor);
+  }
+  windowChannels.clear();
+  chanDestroy(window);
+}
+
+void BearingEngine::stop() {
+  if (!running) {
+    return;
+  }
+
+  stopRtl(rtl);
+  if (reader.joinable()) {
+    reader.join();
+  }
+  closeRtl(rtl);
+  rtl = nullptr;
+  running = false;
+  release(exchange(chan, nullptr), channels);
+
+  lock_guard<mutex> lock(bearingsMutex);
+  bearings.clear();
+}
+
+void BearingEngine::cancel() {
+  {
+    lock_guard<mutex> lock(bearingsMutex);
+    cancelled = true;
+  }
+  bearingsReady.notify_all();
+}
+
+void BearingEngine::resume() {
+  lock_guard<mutex> lock(bearingsMutex);
+  cancelled = false;
+}
+
+optional<vor_bearing_t> BearingEngine::pullBearing(chrono::milliseconds timeout) {
+  auto bearing = pullChannelBearing(timeout);
+  if (!bearing) {
+    return nullopt;
+  }
+  return bearing->second;
+}
+
+optional<pair<double, vor_bearing_t>> BearingEngine::pullChannelBearing(chrono::milliseconds timeout) {
+  unique_lock<mutex> lock(bearingsMutex);
+  if (!bearingsReady.wait_for(lock, timeout, [this]() { return cancelled || !bearings.empty(); })
+      || cancelled) {
+    return nullopt;
+  }
+
+  auto bearing = bearings.front();
+  bearings.pop_front();
+  return bearing;
+}
+
+optional<chrono::microseconds> BearingEngine::waitSettled(chrono::milliseconds timeout) {
+  unique_lock<mutex> lock(bearingsMutex);
+  if (!bearingsReady.wait_for(lock, timeout, [this]() { return cancelled || settledAt.has_value(); })
+      || cancelled) {
+    return nullopt;
+  }
+  return chrono::duration_cast<chrono::microseconds>(*settledAt - tunedAt);
+}
+
+void BearingEngine::attachIdentDecoder(IdentDecoder *decoder) {
+  identDecoder.store(decoder);
+}
+
+void BearingEngine::onSettled(void *arg) {
+  auto engine = static_cast<BearingEngine *>(arg);
+  {
+    lock_guard<mutex> lock(engine->bearingsMutex);
+    engine->settledAt = chrono::steady_clock::now();
+  }
+  engine->bearingsReady.notify_all();
+}
+
+void BearingEngine::onSample(float S, void *arg) {
+  auto engine = static_cast<BearingEngine *>(arg);
+  if (auto decoder = engine->identDecoder.load()) {
+    decoder->push(S);
+  }
+}
+
+void BearingEngine::push(double frequency, const vor_bearing_t& bearing) {
+  {
+    lock_guard<mutex> lock(bearingsMutex);
+    // Averaged over samples from before the last retune
+    if (retunePending(rtl)) {
+      return;
+    }
+    bearings.emplace_back(frequency, bearing);
+  }
+  bearingsReady.notify_all();
+}
+
+void BearingEngine::onBearing(const vor_bearing_t *bearing, void *arg) {
+  auto engine = static_cast<BearingEngine *>(arg);
+  engine->push(engine->tunedFrequency.load(), *bearing);
+}
+
+void BearingEngine::onChannelBearing(const vor_bearing_t *bearing, void *arg) {
+  auto channel = static_cast<Channel *>(arg);
+  channel->engine->push(channel->frequency, *bearing);
+}
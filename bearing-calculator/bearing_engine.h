@@ -0,0 +1,92 @@
+#pragma once
+#include <optional>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include "vorify.h"
+
+using namespace std;
+
+class IdentDecoder;
+
+// In-process owner of one RTL-SDR and its VOR demodulator from rtl.c/vor.c.
+// The device stays open between measurements; retune() only moves the tuner.
+// Engines on different device indexes run independently of each other.
+class BearingEngine {
+  public:
+    explicit BearingEngine(int deviceIndex = 0);
+    ~BearingEngine();
+
+    // Frequencies are in MHz, as listed in VOR.CSV
+    bool start(double frequency);
+    bool retune(double frequency);
+
+    // Tunes to center and demodulates every listed station inside the
+    // tuner bandwidth at once, each on its own 50kHz channel
+    bool tuneWindow(double center, const vector<double>& frequencies);
+
+    void stop();
+    bool isRunning() const { return running; }
+
+    // Wakes pullBearing/waitSettled callers, which return nullopt until
+    // resume(). Retuning leaves the engine cancelled, so a cancel that races
+    // a retune is not lost. Safe to call from any thread.
+    void cancel();
+    void resume();
+
+    // Next averaged bearing produced since the last start/retune
+    optional<vor_bearing_t> pullBearing(chrono::milliseconds timeout);
+
+    // Next (frequency, bearing) from any channel of the current window
+    optional<pair<double, vor_bearing_t>> pullChannelBearing(chrono::milliseconds timeout);
+
+    // Time spent in rtlsdr_set_center_freq by the last start/retune
+    chrono::microseconds retuneLatency() const { return lastRetuneLatency; }
+
+    // Time from the last start/retune until the carrier level was stable
+    optional<chrono::microseconds> waitSettled(chrono::milliseconds timeout);
+
+    // Feed the AM envelope to an ident decoder, or stop with nullptr
+    void attachIdentDecoder(IdentDecoder *decoder);
+
+  private:
+    struct Channel {
+      BearingEngine *engine;
+      double frequency;
+      vor_ctx *vor;
+    };
+
+    void push(double frequency, const vor_bearing_t& bearing);
+    void release(channelizer *window, vector<unique_ptr<Channel>>& windowChannels);
+
+    static void onBearing(const vor_bearing_t *bearing, void *arg);
+    static void onChannelBearing(const vor_bearing_t *bearing, void *arg);
+    static void onSettled(void *arg);
+    static void onSample(float S, void *arg);
+
+    int deviceIndex;
+    vor_ctx *vor = nullptr;
+    rtl_ctx *rtl = nullptr;
+    bool running = false;
+    thread reader;
+    atomic<double> tunedFrequency{0};
+
+    // Current window, or nullptr when tuned to a single station
+    channelizer *chan = nullptr;
+    vector<unique_ptr<Channel>> channels;
+
+    mutex bearingsMutex;
+    condition_variable bearingsReady;
+    deque<pair<double, vor_bearing_t>> bearings;
+    bool cancelled = false;
+
+    chrono::steady_clock::time_point tunedAt;
+    chrono::microseconds lastRetuneLatency{0};
+    optional<chrono::steady_clock::time_point> settledAt;
+    atomic<IdentDecoder *> identDecoder{nullptr};
+};
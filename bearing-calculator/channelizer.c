@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+
+#include "vorify.h"
+#include "dsp_kernels.h"
+
+/*
+ * Critically sampled polyphase filter bank splitting the 2MS/s capture into
+ * 50kHz wide channels on the 50kHz VOR grid, at 50kHz output rate.
+ *
+ * Channel k (k*FSINT above the tuner centre) is
+ *   y_k[m] = sum_i h[i] x[mM-i] e^(j2pi k i/M)
+ *          = sum_p e^(j2pi k p/M) u_p[m],  u_p[m] = sum_q h[qM+p] x[mM-qM-p]
+ * so the M branch filters are run once per output and only the channels in
+ * use pay for their M point DFT bin. The envelope |y_k| feeds one vor()
+ * demodulator per channel, a block at a time, with the channels spread over
+ * the shared pool. The integrate-and-dump in rtl.c is the 1 tap per branch
+ * case of the same structure.
+ */
+
+#define INRATE 2000000
+#define M (INRATE/FSINT)
+#define TAPS_PER_BRANCH 8
+#define L (M*TAPS_PER_BRANCH)
+
+/* channel bandwidth: passes the 9960Hz subcarrier and its deviation, and
+   stops before the sidebands of the next channel alias onto it */
+#define CUTOFF 25000.0
+
+/* envelope samples collected per channel before they are demodulated */
+#define ENV_BLOCK 1024
+
+/* input samples converted to float per kernel call */
+#define CONVERT_BLOCK 2048
+
+typedef struct {
+	int bin;
+	complex float tw[M];
+	vor_ctx_t *vor;
+	float env[ENV_BLOCK];
+} channel_t;
+
+struct channelizer {
+	float h[L];
+	complex float hist[2 * L];
+	int pos;
+	int phase;
+
+	channel_t ch[MAX_CHANNELS];
+	int nch;
+	int nenv;
+};
+
+channelizer_t *chanCreate(void)
+{
+	channelizer_t *chan;
+	double sum = 0;
+	int i;
+
+	chan = calloc(1, sizeof(*chan));
+	if (!chan)
+		return NULL;
+
+	/* Hamming windowed sinc prototype, unity gain at DC */
+	for (i = 0; i < L; i++) {
+		double m = i - (L - 1) / 2.0;
+		double fc = CUTOFF / INRATE;
+		double s = m == 0 ? 2 * fc : sin(2 * M_PI * fc * m) / (M_PI * m);
+		chan->h[i] = s * (0.54 - 0.46 * cos(2 * M_PI * i / (L - 1)));
+		sum += chan->h[i];
+	}
+	for (i = 0; i < L; i++)
+		chan->h[i] /= sum;
+
+	return chan;
+}
+
+void chanDestroy(channelizer_t *chan)
+{
+	free(chan);
+}
+
+int chanAdd(channelizer_t *chan, int offset, vor_ctx_t *vor)
+{
+	channel_t *c;
+	int bin, p;
+
+	if (offset % FSINT) {
+		fprintf(stderr, "Channel offset %d is off the %d Hz grid\n", offset, FSINT);
+		return -1;
+	}
+	bin = offset / FSINT;
+	if (bin == 0 || abs(bin) > MAX_CHANNEL_BIN || chan->nch == MAX_CHANNELS)
+		return -1;
+
+	c = &chan->ch[chan->nch];
+	c->bin = bin;
+	c->vor = vor;
+	for (p = 0; p < M; p++)
+		c->tw[p] = cexpf(I * 2 * M_PI * bin * p / (float)M);
+
+	return chan->nch++;
+}
+
+void chanReset(channelizer_t *chan)
+{
+	int k;
+
+	memset(chan->hist, 0, sizeof(chan->hist));
+	chan->pos = 0;
+	chan->phase = 0;
+	chan->nenv = 0;
+	for (k = 0; k < chan->nch; k++)
+		resetVor(chan->ch[k].vor);
+}
+
+static float output(channelizer_t *chan)
+{
+	complex float u[M];
+	const complex float *x = &chan->hist[chan->pos + L - 1];
+	float level = 0;
+	int p, q, k;
+
+	/* x[-i] is the sample i steps before the newest one */
+	for (p = 0; p < M; p++) {
+		complex float acc = 0;
+		for (q = 0; q < TAPS_PER_BRANCH; q++)
+			acc += chan->h[q * M + p] * x[-(q * M + p)];
+		u[p] = acc;
+	}
+
+	for (k = 0; k < chan->nch; k++) {
+		channel_t *c = &chan->ch[k];
+		complex float y = 0;
+		float S;
+
+		for (p = 0; p < M; p++)
+			y += c->tw[p] * u[p];
+
+		S = cabsf(y) / 128.0;
+		c->env[chan->nenv] = S;
+		level += S;
+	}
+	chan->nenv++;
+
+	return chan->nch ? level / chan->nch : 0;
+}
+
+/* channels are independent, so they are demodulated in parallel */
+static void demodulate(channelizer_t *chan)
+{
+	vor_ctx_t *vor[MAX_CHANNELS];
+	const float *env[MAX_CHANNELS];
+	int k;
+
+	for (k = 0; k < chan->nch; k++) {
+		vor[k] = chan->ch[k].vor;
+		env[k] = chan->ch[k].env;
+	}
+	poolRun(sharedPool(), vor, env, chan->nch, chan->nenv);
+	chan->nenv = 0;
+}
+
+void chanPush(channelizer_t *chan, const unsigned char *buf, unsigned int len,
+	      sample_cb_t cb, void *arg)
+{
+	const dsp_kernels_t *dsp = dspKernels();
+	complex float x[CONVERT_BLOCK];
+	unsigned int i, n, k;
+
+	for (i = 0; i + 1 < len; i += 2 * n) {
+		n = (len - i) / 2 < CONVERT_BLOCK ? (len - i) / 2 : CONVERT_BLOCK;
+		dsp->convert(buf + i, (float *)x, 2 * n, 1.0f);
+
+		for (k = 0; k < n; k++) {
+			/* each sample is stored twice so the last L are always contiguous */
+			chan->hist[chan->pos] = x[k];
+			chan->hist[chan->pos + L] = x[k];
+			chan->pos = (chan->pos + 1) % L;
+
+			if (++chan->phase == M) {
+				float level = output(chan);
+				chan->phase = 0;
+				if (cb)
+					cb(level, arg);
+				if (chan->nenv == ENV_BLOCK)
+					demodulate(chan);
+			}
+		}
+	}
+
+	demodulate(chan);
+}
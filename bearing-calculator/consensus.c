@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "consensus.h"
+
+/* A reading is an outlier when it is further from the mean than TRIM_SPREAD
+   robust standard deviations of the readings, and further than TRIM_FLOOR
+   degrees so readings printed to 0.1 degree are not trimmed for being a
+   step or two apart */
+#define TRIM_SPREAD 3.0
+#define TRIM_FLOOR 1.0
+
+#define DEG (180.0 / M_PI)
+
+/* two-sided 95% Student t quantiles by degrees of freedom */
+static const double T95[] = {
+	0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double t95(int df)
+{
+	return df < (int)(sizeof(T95) / sizeof(T95[0])) ? T95[df] : 1.96;
+}
+
+/* a - b folded into -180..180 */
+static double angleDiff(double a, double b)
+{
+	double d = fmod(a - b, 360.0);
+
+	if (d > 180) d -= 360;
+	if (d < -180) d += 360;
+	return d;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* mean direction of the kept readings, and their resultant length in R */
+static double circularMean(const consensus_t *c, const char *keep, double *R)
+{
+	double cs = 0, sn = 0, mean;
+	int k, used = 0;
+
+	for (k = 0; k < c->n; k++) {
+		if (!keep[k])
+			continue;
+		cs += cos(c->bearing[k] / DEG);
+		sn += sin(c->bearing[k] / DEG);
+		used++;
+	}
+	*R = hypot(cs, sn) / used;
+	mean = atan2(sn, cs) * DEG;
+	return mean < 0 ? mean + 360 : mean;
+}
+
+void consensusInit(consensus_t *c)
+{
+	c->n = 0;
+}
+
+void consensusAdd(consensus_t *c, double bearing, double error)
+{
+	if (c->n == CONSENSUS_MAX)
+		return;
+	c->bearing[c->n] = bearing;
+	c->error[c->n] = error;
+	c->n++;
+}
+
+int consensusEstimate(const consensus_t *c, consensus_result_t *r)
+{
+	char keep[CONSENSUS_MAX];
+	double dev[CONSENSUS_MAX];
+	double mean, R, spread, limit, worstDev, e2 = 0, sigma;
+	int k, m, worst, used = c->n;
+
+	if (c->n < CONSENSUS_MIN)
+		return 0;
+
+	memset(keep, 1, c->n);
+	mean = circularMean(c, keep, &R);
+
+	/* drop the worst outlier and re-centre until none is left; the spread
+	   is the median absolute deviation, which the outliers do not widen */
+	while (used > CONSENSUS_MIN) {
+		for (k = m = 0; k < c->n; k++)
+			if (keep[k])
+				dev[m++] = fabs(angleDiff(c->bearing[k], mean));
+		qsort(dev, m, sizeof(dev[0]), compareDouble);
+		spread = 1.4826 * (m % 2 ? dev[m / 2] : (dev[m / 2 - 1] + dev[m / 2]) / 2);
+		limit = fmax(TRIM_SPREAD * spread, TRIM_FLOOR);
+
+		worst = -1;
+		worstDev = limit;
+		for (k = 0; k < c->n; k++) {
+			double d = keep[k] ? fabs(angleDiff(c->bearing[k], mean)) : 0;
+			if (d > worstDev) {
+				worst = k;
+				worstDev = d;
+			}
+		}
+		if (worst < 0)
+			break;
+
+		keep[worst] = 0;
+		used--;
+		mean = circularMean(c, keep, &R);
+	}
+
+	for (k = 0; k < c->n; k++)
+		if (keep[k])
+			e2 += c->error[k] * c->error[k];
+
+	/* spread of a single reading: what the readings show, corrected for the
+	   small sample, but never less than what the demodulator reported */
+	sigma = R > 1e-9 ? DEG * sqrt(2 * log(1 / fmin(R, 1)) * used / (used - 1)) : 180;
+	sigma = fmax(sigma, sqrt(e2 / used));
+
+	r->bearing = mean;
+	r->resultant = R;
+	r->error = sigma / sqrt(used);
+	r->confidence = t95(used - 1) * r->error;
+	r->used = used;
+	r->trimmed = c->n - used;
+	return 1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most readings a consensus holds; later ones are ignored
+#define CONSENSUS_MAX 64
+
+// Fewest readings an estimate is made from
+#define CONSENSUS_MIN 3
+
+// One bearing agreed on from repeated readings of a station. Readings are
+// averaged on the circle, so 359 and 1 average to 0, and readings far from
+// the rest are trimmed as outliers before the mean is taken.
+typedef struct {
+    double bearing[CONSENSUS_MAX];
+    double error[CONSENSUS_MAX];
+    int n;
+} consensus_t;
+
+typedef struct {
+    double bearing;      // circular mean of the readings kept, degrees
+    double resultant;    // their mean resultant length, 0..1
+    double error;        // standard error of the mean, degrees
+    double confidence;   // half-width of its 95% confidence interval, degrees
+    int used;            // readings kept
+    int trimmed;         // readings dropped as outliers
+} consensus_result_t;
+
+void consensusInit(consensus_t *c);
+
+// error is the reading's own standard error in degrees, or 0 if unknown
+void consensusAdd(consensus_t *c, double bearing, double error);
+
+// Estimates the bearing from the readings so far; returns 0, leaving r
+// untouched, until there are CONSENSUS_MIN of them
+int consensusEstimate(const consensus_t *c, consensus_result_t *r);
+
+#ifdef __cplusplus
+}
+#endif
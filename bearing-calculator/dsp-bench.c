@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "dsp_kernels.h"
+
+/* one RTL buffer's worth of samples at the 2MS/s capture rate */
+#define NSAMPLES (40*2048)
+#define FACTOR 40
+#define SECONDS 0.5
+/* the ident tone band-pass */
+#define TAPS 101
+/* longest block of the fir check, and how far a kernel may stray from
+   firDouble */
+#define CHECK_BLOCK 300
+#define FIR_TOLERANCE 1e-5
+
+static uint8_t iq[2 * NSAMPLES];
+static float in[2 * NSAMPLES], osc[2 * NSAMPLES], out[2 * NSAMPLES], q[NSAMPLES];
+static float taps[TAPS];
+static double dtaps[TAPS], din[NSAMPLES + TAPS], dout[NSAMPLES];
+static float window[TAPS - 1 + CHECK_BLOCK];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* runs a kernel over NSAMPLES complex samples for SECONDS, best of three
+   runs, and returns complex samples per second */
+#define RATE(call) ({ \
+	double best = 0; \
+	int run; \
+	for (run = 0; run < 3; run++) { \
+		double start = now(), t; \
+		long count = 0; \
+		do { \
+			call; \
+			count++; \
+		} while ((t = now() - start) < SECONDS); \
+		if (count * NSAMPLES / t > best) \
+			best = count * NSAMPLES / t; \
+	} \
+	best; })
+
+/* the filter identify-station ran before the fir kernel: scalar, in double */
+static void firDouble(const double *taps, const double *in, double *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m < nout; m++) {
+		double acc = 0;
+		for (k = 0; k < TAPS; k++)
+			acc += taps[k] * in[m + k];
+		out[m] = acc;
+	}
+}
+
+/* Streams the test input through every fir kernel in blocks of random
+   length, carrying the last TAPS - 1 samples from block to block, and
+   compares each output with firDouble over the whole input. Returns 0 if
+   any kernel strays further than FIR_TOLERANCE. */
+static int checkFir(const dsp_kernels_t **list, int n)
+{
+	int i, ok = 1;
+
+	firDouble(dtaps, din, dout, NSAMPLES);
+	for (i = 0; i < n; i++) {
+		size_t done = 0, len, m;
+		double worst = 0;
+
+		srand(1);
+		memcpy(window, in, (TAPS - 1) * sizeof(float));
+		while (done < NSAMPLES) {
+			len = rand() % (CHECK_BLOCK + 1);
+			if (len > NSAMPLES - done)
+				len = NSAMPLES - done;
+			memcpy(window + TAPS - 1, in + TAPS - 1 + done, len * sizeof(float));
+			list[i]->fir(taps, TAPS, window, out + done, len);
+			memmove(window, window + len, (TAPS - 1) * sizeof(float));
+			done += len;
+		}
+
+		for (m = 0; m < NSAMPLES; m++)
+			worst = fmax(worst, fabs(out[m] - dout[m]));
+		printf("fir check %-8s max error %.2g%s\n", list[i]->name, worst,
+		       worst > FIR_TOLERANCE ? "  FAILED" : "");
+		if (worst > FIR_TOLERANCE)
+			ok = 0;
+	}
+	return ok;
+}
+
+int main(void)
+{
+	const dsp_kernels_t *list[8];
+	int n, i;
+
+	for (i = 0; i < 2 * NSAMPLES; i++) {
+		iq[i] = rand();
+		in[i] = (iq[i] - 127.5f) / 127.5f;
+	}
+	for (i = 0; i < NSAMPLES; i++) {
+		osc[2 * i] = cosf(2 * M_PI * i / FACTOR);
+		osc[2 * i + 1] = -sinf(2 * M_PI * i / FACTOR);
+	}
+	for (i = 0; i < TAPS; i++)
+		dtaps[i] = taps[i] = sinf(M_PI * (i + 1) / (TAPS + 1)) / TAPS;
+	for (i = 0; i < NSAMPLES + TAPS; i++)
+		din[i] = in[i];
+
+	n = dspKernelList(list, 8);
+	if (!checkFir(list, n))
+		return 1;
+
+	printf("%-8s %12s %12s %12s %12s %12s %12s\n", "isa", "convert", "deinterleave", "mix", "integrate", "mixDecimate", "fir");
+	for (i = 0; i < n; i++) {
+		const dsp_kernels_t *k = list[i];
+
+		printf("%-8s", k->name);
+		printf(" %12.1f", RATE(k->convert(iq, in, 2 * NSAMPLES, 1 / 127.5f)) / 1e6);
+		printf(" %12.1f", RATE(k->deinterleave(iq, out, q, NSAMPLES, 1 / 127.5f)) / 1e6);
+		printf(" %12.1f", RATE(k->mix(in, osc, out, NSAMPLES)) / 1e6);
+		printf(" %12.1f", RATE(k->integrate(in, FACTOR, out, NSAMPLES / FACTOR)) / 1e6);
+		printf(" %12.1f", RATE(k->mixDecimate(iq, osc, FACTOR, out, NSAMPLES / FACTOR)) / 1e6);
+		printf(" %12.1f", RATE(k->fir(taps, TAPS, in, out, NSAMPLES)) / 1e6);
+		printf("\n");
+	}
+	printf("%-8s %12s %12s %12s %12s %12s %12.1f\n", "double", "-", "-", "-", "-", "-",
+	       RATE(firDouble(dtaps, din, dout, NSAMPLES)) / 1e6);
+	printf("(million complex samples per second; fir: million outputs per second of a\n"
+	       " %d-tap real filter, double: the same in scalar double precision)\n", TAPS);
+	return 0;
+}
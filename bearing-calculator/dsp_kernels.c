@@ -0,0 +1,551 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "dsp_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DSP_X86 1
+#endif
+
+/*
+ * NEON is always there on aarch64. The 32-bit Raspberry Pi OS toolchain
+ * targets VFP only, so there the NEON kernels enable it per function and
+ * are only picked when the kernel reports NEON at run time.
+ */
+#if defined(__aarch64__) || (defined(__arm__) && defined(__ARM_FP))
+#include <arm_neon.h>
+#define DSP_NEON 1
+#endif
+
+#if defined(DSP_NEON) && !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define NEON __attribute__((target("fpu=neon")))
+#else
+#define NEON
+#endif
+
+/*
+ * Scalar kernels, also used for the tails the vector kernels leave over.
+ * Bytes go through a table rather than an int to float conversion.
+ */
+
+static float u8f[256];
+
+static void convert_scalar(const uint8_t *in, float *out, size_t n, float scale)
+{
+	size_t k;
+
+	for (k = 0; k < n; k++)
+		out[k] = u8f[in[k]] * scale;
+}
+
+static void deinterleave_scalar(const uint8_t *in, float *i, float *q, size_t n, float scale)
+{
+	size_t k;
+
+	for (k = 0; k < n; k++) {
+		i[k] = u8f[in[2 * k]] * scale;
+		q[k] = u8f[in[2 * k + 1]] * scale;
+	}
+}
+
+static void mix_scalar(const float *in, const float *osc, float *out, size_t n)
+{
+	size_t k;
+
+	for (k = 0; k < n; k++) {
+		float xr = in[2 * k], xi = in[2 * k + 1];
+		float or = osc[2 * k], oi = osc[2 * k + 1];
+		out[2 * k] = xr * or - xi * oi;
+		out[2 * k + 1] = xr * oi + xi * or;
+	}
+}
+
+static void integrate_scalar(const float *in, size_t factor, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m < nout; m++) {
+		float re = 0, im = 0;
+		for (k = 0; k < factor; k++) {
+			re += in[2 * (m * factor + k)];
+			im += in[2 * (m * factor + k) + 1];
+		}
+		out[2 * m] = re;
+		out[2 * m + 1] = im;
+	}
+}
+
+/* one output of mixDecimate from sample k on, added to re, im */
+static void mix_dump_tail(const uint8_t *iq, const float *osc, size_t k, size_t factor, float *re, float *im)
+{
+	for (; k < factor; k++) {
+		float xr = u8f[iq[2 * k]], xi = u8f[iq[2 * k + 1]];
+		*re += xr * osc[2 * k] - xi * osc[2 * k + 1];
+		*im += xr * osc[2 * k + 1] + xi * osc[2 * k];
+	}
+}
+
+static void mixDecimate_scalar(const uint8_t *iq, const float *osc, size_t factor, float *out, size_t nout)
+{
+	size_t m;
+
+	for (m = 0; m < nout; m++) {
+		float re = 0, im = 0;
+		mix_dump_tail(iq + 2 * m * factor, osc, 0, factor, &re, &im);
+		out[2 * m] = re;
+		out[2 * m + 1] = im;
+	}
+}
+
+static void fir_scalar(const float *taps, size_t ntaps, const float *in, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m < nout; m++) {
+		float acc = 0;
+		for (k = 0; k < ntaps; k++)
+			acc += taps[k] * in[m + k];
+		out[m] = acc;
+	}
+}
+
+static const dsp_kernels_t scalar = {
+	"scalar", convert_scalar, deinterleave_scalar, mix_scalar, integrate_scalar, mixDecimate_scalar,
+	fir_scalar
+};
+
+#ifdef DSP_X86
+
+/*
+ * SSE2, part of every x86-64 CPU. Four floats, two complex samples, per
+ * register.
+ */
+
+/* 4 bytes to 4 floats less 127.5 */
+static inline __m128 sse_u8x4(const uint8_t *in)
+{
+	__m128i z = _mm_setzero_si128();
+	int32_t word;
+	__m128i b;
+
+	memcpy(&word, in, sizeof(word));
+	b = _mm_cvtsi32_si128(word);
+	b = _mm_unpacklo_epi16(_mm_unpacklo_epi8(b, z), z);
+	return _mm_sub_ps(_mm_cvtepi32_ps(b), _mm_set1_ps(127.5f));
+}
+
+/* (a0 + j a1, a2 + j a3) * (b0 + j b1, b2 + j b3) */
+static inline __m128 sse_cmul(__m128 a, __m128 b)
+{
+	__m128 re = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 0, 0));
+	__m128 im = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128 swap = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sign = _mm_castsi128_ps(_mm_set_epi32(0, 0x80000000, 0, 0x80000000));
+	return _mm_add_ps(_mm_mul_ps(re, b), _mm_xor_ps(_mm_mul_ps(im, swap), sign));
+}
+
+/* sum of the two complex samples in a */
+static inline void sse_csum(__m128 a, float *re, float *im)
+{
+	float v[4];
+	_mm_storeu_ps(v, a);
+	*re += v[0] + v[2];
+	*im += v[1] + v[3];
+}
+
+static void convert_sse2(const uint8_t *in, float *out, size_t n, float scale)
+{
+	__m128 s = _mm_set1_ps(scale);
+	size_t k;
+
+	for (k = 0; k + 4 <= n; k += 4)
+		_mm_storeu_ps(out + k, _mm_mul_ps(sse_u8x4(in + k), s));
+	convert_scalar(in + k, out + k, n - k, scale);
+}
+
+static void deinterleave_sse2(const uint8_t *in, float *i, float *q, size_t n, float scale)
+{
+	__m128 s = _mm_set1_ps(scale);
+	size_t k;
+
+	for (k = 0; k + 4 <= n; k += 4) {
+		__m128 a = sse_u8x4(in + 2 * k), b = sse_u8x4(in + 2 * k + 4);
+		_mm_storeu_ps(i + k, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), s));
+		_mm_storeu_ps(q + k, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), s));
+	}
+	deinterleave_scalar(in + 2 * k, i + k, q + k, n - k, scale);
+}
+
+static void mix_sse2(const float *in, const float *osc, float *out, size_t n)
+{
+	size_t k;
+
+	for (k = 0; k + 2 <= n; k += 2)
+		_mm_storeu_ps(out + 2 * k, sse_cmul(_mm_loadu_ps(in + 2 * k), _mm_loadu_ps(osc + 2 * k)));
+	mix_scalar(in + 2 * k, osc + 2 * k, out + 2 * k, n - k);
+}
+
+static void integrate_sse2(const float *in, size_t factor, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m < nout; m++) {
+		const float *x = in + 2 * m * factor;
+		__m128 acc = _mm_setzero_ps();
+		float re = 0, im = 0;
+		for (k = 0; k + 2 <= factor; k += 2)
+			acc = _mm_add_ps(acc, _mm_loadu_ps(x + 2 * k));
+		for (; k < factor; k++) {
+			re += x[2 * k];
+			im += x[2 * k + 1];
+		}
+		sse_csum(acc, &re, &im);
+		out[2 * m] = re;
+		out[2 * m + 1] = im;
+	}
+}
+
+static void mixDecimate_sse2(const uint8_t *iq, const float *osc, size_t factor, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m < nout; m++) {
+		const uint8_t *x = iq + 2 * m * factor;
+		__m128 acc = _mm_setzero_ps();
+		float re = 0, im = 0;
+		for (k = 0; k + 2 <= factor; k += 2)
+			acc = _mm_add_ps(acc, sse_cmul(sse_u8x4(x + 2 * k), _mm_loadu_ps(osc + 2 * k)));
+		mix_dump_tail(x, osc, k, factor, &re, &im);
+		sse_csum(acc, &re, &im);
+		out[2 * m] = re;
+		out[2 * m + 1] = im;
+	}
+}
+
+/* eight outputs at a time, each tap broadcast against the inputs under it */
+static void fir_sse2(const float *taps, size_t ntaps, const float *in, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m + 8 <= nout; m += 8) {
+		__m128 a = _mm_setzero_ps(), b = _mm_setzero_ps();
+		for (k = 0; k < ntaps; k++) {
+			__m128 t = _mm_set1_ps(taps[k]);
+			a = _mm_add_ps(a, _mm_mul_ps(t, _mm_loadu_ps(in + m + k)));
+			b = _mm_add_ps(b, _mm_mul_ps(t, _mm_loadu_ps(in + m + k + 4)));
+		}
+		_mm_storeu_ps(out + m, a);
+		_mm_storeu_ps(out + m + 4, b);
+	}
+	fir_scalar(taps, ntaps, in + m, out + m, nout - m);
+}
+
+static const dsp_kernels_t sse2 = {
+	"sse2", convert_sse2, deinterleave_sse2, mix_sse2, integrate_sse2, mixDecimate_sse2,
+	fir_sse2
+};
+
+/*
+ * AVX2 with FMA: eight floats, four complex samples, per register.
+ */
+
+#define AVX2 __attribute__((target("avx2,fma")))
+
+/* 8 bytes to 8 floats less 127.5 */
+AVX2 static inline __m256 avx_u8x8(const uint8_t *in)
+{
+	__m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)in));
+	return _mm256_sub_ps(_mm256_cvtepi32_ps(b), _mm256_set1_ps(127.5f));
+}
+
+AVX2 static inline __m256 avx_cmul(__m256 a, __m256 b)
+{
+	__m256 swap = _mm256_permute_ps(b, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm256_fmaddsub_ps(_mm256_moveldup_ps(a), b, _mm256_mul_ps(_mm256_movehdup_ps(a), swap));
+}
+
+AVX2 static inline void avx_csum(__m256 a, float *re, float *im)
+{
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	sse_csum(s, re, im);
+}
+
+AVX2 static void convert_avx2(const uint8_t *in, float *out, size_t n, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+	size_t k;
+
+	for (k = 0; k + 8 <= n; k += 8)
+		_mm256_storeu_ps(out + k, _mm256_mul_ps(avx_u8x8(in + k), s));
+	convert_scalar(in + k, out + k, n - k, scale);
+}
+
+AVX2 static void deinterleave_avx2(const uint8_t *in, float *i, float *q, size_t n, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+	size_t k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		__m256 a = avx_u8x8(in + 2 * k), b = avx_u8x8(in + 2 * k + 8);
+		/* in-lane shuffles leave the 64-bit halves in 0, 2, 1, 3 order */
+		__m256 re = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 im = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(re), _MM_SHUFFLE(3, 1, 2, 0)));
+		im = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(im), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(i + k, _mm256_mul_ps(re, s));
+		_mm256_storeu_ps(q + k, _mm256_mul_ps(im, s));
+	}
+	deinterleave_scalar(in + 2 * k, i + k, q + k, n - k, scale);
+}
+
+AVX2 static void mix_avx2(const float *in, const float *osc, float *out, size_t n)
+{
+	size_t k;
+
+	for (k = 0; k + 4 <= n; k += 4)
+		_mm256_storeu_ps(out + 2 * k, avx_cmul(_mm256_loadu_ps(in + 2 * k), _mm256_loadu_ps(osc + 2 * k)));
+	mix_scalar(in + 2 * k, osc + 2 * k, out + 2 * k, n - k);
+}
+
+AVX2 static void integrate_avx2(const float *in, size_t factor, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m < nout; m++) {
+		const float *x = in + 2 * m * factor;
+		__m256 acc = _mm256_setzero_ps();
+		float re = 0, im = 0;
+		for (k = 0; k + 4 <= factor; k += 4)
+			acc = _mm256_add_ps(acc, _mm256_loadu_ps(x + 2 * k));
+		for (; k < factor; k++) {
+			re += x[2 * k];
+			im += x[2 * k + 1];
+		}
+		avx_csum(acc, &re, &im);
+		out[2 * m] = re;
+		out[2 * m + 1] = im;
+	}
+}
+
+AVX2 static void mixDecimate_avx2(const uint8_t *iq, const float *osc, size_t factor, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m < nout; m++) {
+		const uint8_t *x = iq + 2 * m * factor;
+		__m256 acc = _mm256_setzero_ps();
+		float re = 0, im = 0;
+		for (k = 0; k + 4 <= factor; k += 4)
+			acc = _mm256_add_ps(acc, avx_cmul(avx_u8x8(x + 2 * k), _mm256_loadu_ps(osc + 2 * k)));
+		mix_dump_tail(x, osc, k, factor, &re, &im);
+		avx_csum(acc, &re, &im);
+		out[2 * m] = re;
+		out[2 * m + 1] = im;
+	}
+}
+
+AVX2 static void fir_avx2(const float *taps, size_t ntaps, const float *in, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m + 16 <= nout; m += 16) {
+		__m256 a = _mm256_setzero_ps(), b = _mm256_setzero_ps();
+		for (k = 0; k < ntaps; k++) {
+			__m256 t = _mm256_set1_ps(taps[k]);
+			a = _mm256_fmadd_ps(t, _mm256_loadu_ps(in + m + k), a);
+			b = _mm256_fmadd_ps(t, _mm256_loadu_ps(in + m + k + 8), b);
+		}
+		_mm256_storeu_ps(out + m, a);
+		_mm256_storeu_ps(out + m + 8, b);
+	}
+	fir_sse2(taps, ntaps, in + m, out + m, nout - m);
+}
+
+static const dsp_kernels_t avx2 = {
+	"avx2", convert_avx2, deinterleave_avx2, mix_avx2, integrate_avx2, mixDecimate_avx2,
+	fir_avx2
+};
+
+#endif /* DSP_X86 */
+
+#ifdef DSP_NEON
+
+/*
+ * NEON, on every Pi from the 2 on. vld2 splits I from Q on load, so the
+ * complex math works on separate real and imaginary registers.
+ */
+
+/* 8 bytes to two registers of floats less 127.5 */
+NEON static inline void neon_u8x8(uint8x8_t b, float32x4_t *lo, float32x4_t *hi)
+{
+	uint16x8_t w = vmovl_u8(b);
+	float32x4_t bias = vdupq_n_f32(127.5f);
+	*lo = vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(w))), bias);
+	*hi = vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(w))), bias);
+}
+
+NEON static inline float neon_sum(float32x4_t a)
+{
+	float32x2_t s = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+	return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+NEON static void convert_neon(const uint8_t *in, float *out, size_t n, float scale)
+{
+	size_t k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		float32x4_t lo, hi;
+		neon_u8x8(vld1_u8(in + k), &lo, &hi);
+		vst1q_f32(out + k, vmulq_n_f32(lo, scale));
+		vst1q_f32(out + k + 4, vmulq_n_f32(hi, scale));
+	}
+	convert_scalar(in + k, out + k, n - k, scale);
+}
+
+NEON static void deinterleave_neon(const uint8_t *in, float *i, float *q, size_t n, float scale)
+{
+	size_t k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		uint8x8x2_t b = vld2_u8(in + 2 * k);
+		float32x4_t lo, hi;
+		neon_u8x8(b.val[0], &lo, &hi);
+		vst1q_f32(i + k, vmulq_n_f32(lo, scale));
+		vst1q_f32(i + k + 4, vmulq_n_f32(hi, scale));
+		neon_u8x8(b.val[1], &lo, &hi);
+		vst1q_f32(q + k, vmulq_n_f32(lo, scale));
+		vst1q_f32(q + k + 4, vmulq_n_f32(hi, scale));
+	}
+	deinterleave_scalar(in + 2 * k, i + k, q + k, n - k, scale);
+}
+
+NEON static void mix_neon(const float *in, const float *osc, float *out, size_t n)
+{
+	size_t k;
+
+	for (k = 0; k + 4 <= n; k += 4) {
+		float32x4x2_t x = vld2q_f32(in + 2 * k), o = vld2q_f32(osc + 2 * k), y;
+		y.val[0] = vmlsq_f32(vmulq_f32(x.val[0], o.val[0]), x.val[1], o.val[1]);
+		y.val[1] = vmlaq_f32(vmulq_f32(x.val[0], o.val[1]), x.val[1], o.val[0]);
+		vst2q_f32(out + 2 * k, y);
+	}
+	mix_scalar(in + 2 * k, osc + 2 * k, out + 2 * k, n - k);
+}
+
+NEON static void integrate_neon(const float *in, size_t factor, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m < nout; m++) {
+		const float *x = in + 2 * m * factor;
+		float32x4_t re4 = vdupq_n_f32(0), im4 = vdupq_n_f32(0);
+		float re = 0, im = 0;
+		for (k = 0; k + 4 <= factor; k += 4) {
+			float32x4x2_t v = vld2q_f32(x + 2 * k);
+			re4 = vaddq_f32(re4, v.val[0]);
+			im4 = vaddq_f32(im4, v.val[1]);
+		}
+		for (; k < factor; k++) {
+			re += x[2 * k];
+			im += x[2 * k + 1];
+		}
+		out[2 * m] = re + neon_sum(re4);
+		out[2 * m + 1] = im + neon_sum(im4);
+	}
+}
+
+NEON static void mixDecimate_neon(const uint8_t *iq, const float *osc, size_t factor, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m < nout; m++) {
+		const uint8_t *x = iq + 2 * m * factor;
+		float32x4_t re4 = vdupq_n_f32(0), im4 = vdupq_n_f32(0);
+		float re = 0, im = 0;
+		for (k = 0; k + 8 <= factor; k += 8) {
+			uint8x8x2_t b = vld2_u8(x + 2 * k);
+			float32x4_t xr[2], xi[2];
+			int h;
+			neon_u8x8(b.val[0], &xr[0], &xr[1]);
+			neon_u8x8(b.val[1], &xi[0], &xi[1]);
+			for (h = 0; h < 2; h++) {
+				float32x4x2_t o = vld2q_f32(osc + 2 * (k + 4 * h));
+				re4 = vmlsq_f32(vmlaq_f32(re4, xr[h], o.val[0]), xi[h], o.val[1]);
+				im4 = vmlaq_f32(vmlaq_f32(im4, xr[h], o.val[1]), xi[h], o.val[0]);
+			}
+		}
+		mix_dump_tail(x, osc, k, factor, &re, &im);
+		out[2 * m] = re + neon_sum(re4);
+		out[2 * m + 1] = im + neon_sum(im4);
+	}
+}
+
+NEON static void fir_neon(const float *taps, size_t ntaps, const float *in, float *out, size_t nout)
+{
+	size_t m, k;
+
+	for (m = 0; m + 8 <= nout; m += 8) {
+		float32x4_t a = vdupq_n_f32(0), b = vdupq_n_f32(0);
+		for (k = 0; k < ntaps; k++) {
+			a = vmlaq_n_f32(a, vld1q_f32(in + m + k), taps[k]);
+			b = vmlaq_n_f32(b, vld1q_f32(in + m + k + 4), taps[k]);
+		}
+		vst1q_f32(out + m, a);
+		vst1q_f32(out + m + 4, b);
+	}
+	fir_scalar(taps, ntaps, in + m, out + m, nout - m);
+}
+
+static const dsp_kernels_t neon = {
+	"neon", convert_neon, deinterleave_neon, mix_neon, integrate_neon, mixDecimate_neon,
+	fir_neon
+};
+
+#endif /* DSP_NEON */
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static const dsp_kernels_t *available[4];
+static int navailable;
+
+static void init(void)
+{
+	int k;
+
+	for (k = 0; k < 256; k++)
+		u8f[k] = k - 127.5f;
+
+	available[navailable++] = &scalar;
+#ifdef DSP_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		available[navailable++] = &sse2;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		available[navailable++] = &avx2;
+#endif
+#if defined(DSP_NEON) && defined(__aarch64__)
+	available[navailable++] = &neon;
+#elif defined(DSP_NEON)
+	if (getauxval(AT_HWCAP) & HWCAP_NEON)
+		available[navailable++] = &neon;
+#endif
+}
+
+const dsp_kernels_t *dspKernels(void)
+{
+	pthread_once(&once, init);
+	return available[navailable - 1];
+}
+
+int dspKernelList(const dsp_kernels_t **list, int max)
+{
+	int k;
+
+	pthread_once(&once, init);
+	for (k = 0; k < navailable && k < max; k++)
+		list[k] = available[k];
+	return k;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Front-end kernels for 8-bit RTL I/Q, one implementation per instruction
+// set. Complex buffers are interleaved re, im float pairs and n counts
+// complex samples. Every implementation gives the same results as the
+// scalar one up to float rounding.
+typedef struct {
+    const char *name;
+
+    // out[i] = (in[i] - 127.5) * scale over n bytes
+    void (*convert)(const uint8_t *in, float *out, size_t n, float scale);
+
+    // Splits n interleaved I/Q byte pairs into two float arrays, scaled as
+    // in convert
+    void (*deinterleave)(const uint8_t *in, float *i, float *q, size_t n, float scale);
+
+    // out[k] = in[k] * osc[k]
+    void (*mix)(const float *in, const float *osc, float *out, size_t n);
+
+    // out[m] = sum of in[m * factor + k] for k < factor
+    void (*integrate)(const float *in, size_t factor, float *out, size_t nout);
+
+    // Mixes raw bytes with one period of osc and dumps every factor samples:
+    // out[m] = sum of (iq[m * factor + k] - 127.5) * osc[k] for k < factor
+    void (*mixDecimate)(const uint8_t *iq, const float *osc, size_t factor, float *out, size_t nout);
+
+    // Real FIR over a window holding ntaps - 1 samples of history before the
+    // new ones, taps in time-reversed order:
+    // out[m] = sum of taps[k] * in[m + k] for k < ntaps
+    void (*fir)(const float *taps, size_t ntaps, const float *in, float *out, size_t nout);
+} dsp_kernels_t;
+
+// The fastest implementation this CPU runs, chosen on first use
+const dsp_kernels_t *dspKernels(void);
+
+// Every implementation compiled in that this CPU runs, scalar first, for
+// benchmarks and tests; returns how many were stored
+int dspKernelList(const dsp_kernels_t **list, int max);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Keys idents as 1020Hz tone on a noisy AM envelope at the ident speeds
+ * VORs use and checks that IdentDecoder reads them back. Covers all-dash
+ * idents, whose shortest mark is a dash, and idents mixing both elements.
+ * Prints every decode and exits 1 if any is wrong.
+ */
+#include <iostream>
+#include <random>
+#include <cmath>
+#include "ident_decoder.h"
+#include "vorify.h"
+
+using namespace std;
+
+constexpr double IDENT_FREQUENCY = 1020.0;
+constexpr double CARRIER = 1.0;
+constexpr double DEPTH = 0.1;
+constexpr double NOISE = 0.05;
+
+// Silence between repetitions, as VORs key the ident every 7-10 seconds
+constexpr double REPEAT_GAP = 3.0;
+
+static const char *letters[26] = {
+  ".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..", ".---",
+  "-.-", ".-..", "--", "-.", "---", ".--.", "--.-", ".-.", "...", "-",
+  "..-", "...-", ".--", "-..-", "-.--", "--..",
+};
+
+// Keying as (tone on, units); a dot is one unit
+static vector<pair<bool, int>> keying(const string& ident) {
+  vector<pair<bool, int>> elements;
+  for (char c : ident) {
+    if (!elements.empty()) {
+      elements.emplace_back(false, 3);
+    }
+    for (const char *e = letters[c - 'A']; *e; e++) {
+      if (e != letters[c - 'A']) {
+        elements.emplace_back(false, 1);
+      }
+      elements.emplace_back(true, *e == '.' ? 1 : 3);
+    }
+  }
+  return elements;
+}
+
+static bool check(const string& ident, double wpm, mt19937& rng) {
+  normal_distribution<double> noise(0.0, NOISE);
+  IdentDecoder decoder;
+  long t = 0;
+  auto emit = [&](bool on, double seconds) {
+    for (long end = t + lround(seconds * FSINT); t < end; t++) {
+      double tone = on ? DEPTH * sin(2 * M_PI * IDENT_FREQUENCY * t / FSINT) : 0;
+      decoder.push(CARRIER + tone + noise(rng));
+    }
+  };
+
+  // A dot of the standard word PARIS
+  double dot = 1.2 / wpm;
+  for (int repeat = 0; repeat < 3; repeat++) {
+    emit(false, REPEAT_GAP);
+    for (auto [on, units] : keying(ident)) {
+      emit(on, units * dot);
+    }
+  }
+  emit(false, REPEAT_GAP);
+
+  optional<string> decoded = decoder.ident();
+  bool ok = decoded == ident;
+  cout << ident << " at " << wpm << " wpm: " << decoded.value_or("(none)") << (ok ? "" : "  FAILED") << endl;
+  return ok;
+}
+
+int main() {
+  mt19937 rng(1);
+  bool ok = true;
+  for (double wpm : {6.0, 7.0, 10.0}) {
+    for (const char *ident : {"TTT", "OTT", "MOT", "MTT", "TOM", "BGN", "SES", "EHS", "MZD", "BSA"}) {
+      ok = check(ident, wpm, rng) && ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
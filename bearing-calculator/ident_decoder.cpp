@@ -0,0 +1,143 @@
+#include "ident_decoder.h"
+#include "vorify.h"
+#include <cmath>
+#include <map>
+
+using namespace std;
+
+// Tone detection runs on 10ms blocks. The 1020Hz ident is picked up in the
+// 1000Hz bin, which has a whole number of cycles per block and so does not
+// see the carrier DC of the envelope.
+constexpr int BLOCK = FSINT / 100;
+constexpr double IDENT_BIN = 1000.0;
+
+// Silence longer than this separates two repetitions of the ident
+constexpr int WORD_GAP_BLOCKS = 100;
+
+// Idents are keyed at about 7 words per minute, a 170ms dot and a 510ms dash
+constexpr double DOT_DASH_BLOCKS = 30;
+
+static const map<string, char> morseMap = {
+  {".-", 'A'}, {"-...", 'B'}, {"-.-.", 'C'}, {"-..", 'D'},
+  {".", 'E'}, {"..-.", 'F'}, {"--.", 'G'}, {"....", 'H'},
+  {"..", 'I'}, {".---", 'J'}, {"-.-", 'K'}, {".-..", 'L'},
+  {"--", 'M'}, {"-.", 'N'}, {"---", 'O'}, {".--.", 'P'},
+  {"--.-", 'Q'}, {".-.", 'R'}, {"...", 'S'}, {"-", 'T'},
+  {"..-", 'U'}, {"...-", 'V'}, {".--", 'W'}, {"-..-", 'X'},
+  {"-.--", 'Y'}, {"--..", 'Z'},
+  {"-----", '0'}, {".----", '1'}, {"..---", '2'},
+  {"...--", '3'}, {"....-", '4'}, {".....", '5'},
+  {"-....", '6'}, {"--...", '7'}, {"---..", '8'},
+  {"----.", '9'},
+};
+
+IdentDecoder::IdentDecoder() {
+  coeff = 2 * cos(2 * M_PI * IDENT_BIN / FSINT);
+}
+
+void IdentDecoder::reset() {
+  s1 = s2 = 0;
+  count = 0;
+  floor = peak = 0;
+  tone = false;
+  run = 0;
+  armed = false;
+  runs.clear();
+
+  lock_guard<mutex> lock(decodedMutex);
+  decoded = nullopt;
+}
+
+optional<string> IdentDecoder::ident() const {
+  lock_guard<mutex> lock(decodedMutex);
+  return decoded;
+}
+
+void IdentDecoder::push(float S) {
+  double s = S + coeff * s1 - s2;
+  s2 = s1;
+  s1 = s;
+
+  if (++count < BLOCK) {
+    return;
+  }
+
+  double power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+  double amplitude = 2 * sqrt(fmax(power, 0)) / BLOCK;
+
+  // Track the noise floor and the keyed level to place the threshold
+  floor = floor == 0 ? amplitude : fmin(amplitude, floor * 1.01);
+  peak = fmax(amplitude, peak * 0.999);
+  bool on = peak > 3 * floor && amplitude > (floor + peak) / 2;
+
+  s1 = s2 = 0;
+  count = 0;
+
+  block(on);
+}
+
+void IdentDecoder::block(bool on) {
+  if (on == tone) {
+    ++run;
+    return;
+  }
+
+  if (!tone && run >= WORD_GAP_BLOCKS) {
+    if (armed && !runs.empty()) {
+      decode();
+    }
+    armed = true;
+    runs.clear();
+  } else if (armed) {
+    runs.emplace_back(tone, run);
+  }
+
+  tone = on;
+  run = 1;
+}
+
+void IdentDecoder::decode() {
+  // Dots and the gaps inside a letter are one unit, dashes and letter gaps
+  // three. Split all run lengths into those two groups; the shortest mark
+  // alone would take the dash of an all-dash ident for a dot.
+  double low = 0, high = 0;
+  for (auto& [mark, length] : runs) {
+    low = low == 0 ? length : fmin(low, length);
+    high = fmax(high, length);
+  }
+
+  double split;
+  if (high < 2 * low) {
+    // One length only, as in TTT: tell units from threes by the keying speed
+    split = low < DOT_DASH_BLOCKS ? HUGE_VAL : 0;
+  } else {
+    for (int i = 0; i < 10; ++i) {
+      split = (low + high) / 2;
+      double sums[2] = {0, 0};
+      int counts[2] = {0, 0};
+      for (auto& [mark, length] : runs) {
+        sums[length >= split] += length;
+        counts[length >= split]++;
+      }
+      low = sums[0] / counts[0];
+      high = sums[1] / counts[1];
+    }
+    split = (low + high) / 2;
+  }
+
+  string ident, morse;
+  for (auto& [mark, length] : runs) {
+    if (mark) {
+      morse += length < split ? '.' : '-';
+    } else if (length >= split) {
+      auto it = morseMap.find(morse);
+      ident += it != morseMap.end() ? it->second : '?';
+      morse.clear();
+    }
+  }
+  auto it = morseMap.find(morse);
+  ident += it != morseMap.end() ? it->second : '?';
+
+  lock_guard<mutex> lock(decodedMutex);
+  decoded = ident;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <vector>
+#include <mutex>
+
+using namespace std;
+
+// Decodes the 1020Hz morse ident keyed on the VOR carrier from the same
+// 50kHz AM envelope the bearing demodulator uses, so identification needs
+// no separate capture at another sample rate.
+class IdentDecoder {
+  public:
+    IdentDecoder();
+    void reset();
+    void push(float S);
+
+    // Set once a full ident, bracketed by silence on both sides, was heard.
+    // Safe to call while another thread is pushing samples.
+    optional<string> ident() const;
+
+  private:
+    void block(bool on);
+    void decode();
+
+    double coeff;
+    double s1 = 0, s2 = 0;
+    int count = 0;
+
+    double floor = 0, peak = 0;
+    bool tone = false;
+    int run = 0;
+    bool armed = false;
+    vector<pair<bool, int>> runs;
+    mutable mutex decodedMutex;
+    optional<string> decoded;
+};
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "vorify.h"
+
+/*
+ * Fixed set of worker threads fed from one queue of demodulation tasks.
+ * Tasks and their batch live on the stack of the poolRun() call that queued
+ * them, which does not return before every one of them has been run.
+ */
+
+struct batch {
+	int remaining;
+};
+
+struct task {
+	vor_ctx_t *ctx;
+	const float *S;
+	int n;
+	struct batch *batch;
+	struct task *next;
+};
+
+struct vor_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;	/* tasks queued, or stopping */
+	pthread_cond_t done;	/* a batch finished */
+	struct task *head, *tail;
+	int stopping;
+	int nthreads;
+	pthread_t threads[];
+};
+
+/* called with the lock held */
+static struct task *take(vor_pool_t *pool)
+{
+	struct task *t = pool->head;
+
+	if (t) {
+		pool->head = t->next;
+		if (!pool->head)
+			pool->tail = NULL;
+	}
+	return t;
+}
+
+/* runs t with the lock released; returns with it held again */
+static void runTask(vor_pool_t *pool, struct task *t)
+{
+	struct batch *batch = t->batch;
+
+	pthread_mutex_unlock(&pool->lock);
+	vorProcessBlock(t->ctx, t->S, t->n);
+	pthread_mutex_lock(&pool->lock);
+
+	if (--batch->remaining == 0)
+		pthread_cond_broadcast(&pool->done);
+}
+
+static void *worker(void *arg)
+{
+	vor_pool_t *pool = arg;
+	struct task *t;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->head && !pool->stopping)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		t = take(pool);
+		if (!t)
+			break;
+		runTask(pool, t);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+vor_pool_t *poolCreate(int threads)
+{
+	vor_pool_t *pool;
+	int i;
+
+	if (threads < 0)
+		threads = 0;
+	pool = calloc(1, sizeof(*pool) + threads * sizeof(pthread_t));
+	if (!pool)
+		return NULL;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker, pool)) {
+			fprintf(stderr, "Started %d of %d demodulator threads\n", i, threads);
+			break;
+		}
+	}
+	pool->nthreads = i;
+	return pool;
+}
+
+void poolDestroy(vor_pool_t *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+void poolRun(vor_pool_t *pool, vor_ctx_t **ctx, const float **S, int count, int n)
+{
+	struct batch batch = { count };
+	struct task *t;
+	int k;
+
+	if (count <= 0)
+		return;
+	if (count == 1 || !pool || !pool->nthreads) {
+		for (k = 0; k < count; k++)
+			vorProcessBlock(ctx[k], S[k], n);
+		return;
+	}
+
+	struct task tasks[count];
+
+	for (k = 0; k < count; k++) {
+		tasks[k].ctx = ctx[k];
+		tasks[k].S = S[k];
+		tasks[k].n = n;
+		tasks[k].batch = &batch;
+		tasks[k].next = k + 1 < count ? &tasks[k + 1] : NULL;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->tail)
+		pool->tail->next = &tasks[0];
+	else
+		pool->head = &tasks[0];
+	pool->tail = &tasks[count - 1];
+	pthread_cond_broadcast(&pool->work);
+
+	/* help with whatever is queued, ours or another caller's, then wait
+	   for the workers still running our tasks */
+	while (batch.remaining) {
+		t = take(pool);
+		if (t)
+			runTask(pool, t);
+		else
+			pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static vor_pool_t *shared;
+static pthread_once_t sharedOnce = PTHREAD_ONCE_INIT;
+
+static void createShared(void)
+{
+	shared = poolCreate(sysconf(_SC_NPROCESSORS_ONLN) - 1);
+}
+
+vor_pool_t *sharedPool(void)
+{
+	pthread_once(&sharedOnce, createShared);
+	return shared;
+}
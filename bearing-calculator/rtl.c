@@ -6,27 +6,55 @@
 #include <sys/resource.h>
 #include <math.h>
 #include <complex.h>
+#include <stdatomic.h>
 
 #include <rtl-sdr.h>
 #include "vorify.h"
+#include "dsp_kernels.h"
 
 #define INRATE 2000000
 #define IFFREQ 50000
 #define DOWNSC (INRATE/FSINT)
 
 #define INBUFSZ (DOWNSC*2048)
+#define INBUFNUM 8
 
-extern int ppm;
-extern int verbose;
-extern int gain;
+/* decimated samples taken from the mix and dump kernel per call */
+#define DUMP_BLOCK 256
 
-extern void vor(float V);
+/* samples still queued in the USB buffers when the tuner is moved */
+#define RETUNE_SETTLE (INBUFNUM*INBUFSZ/2)
 
-static rtlsdr_dev_t *dev = NULL;
+/* carrier level is compared over blocks of one 30Hz cycle, so the
+   variable signal AM averages out, to detect tuner settling */
+#define SETTLE_BLOCK (FSINT/30)
+#define SETTLE_TOLERANCE 0.05
 
-complex float Osc[DOWNSC];
+struct rtl_ctx {
+	rtlsdr_dev_t *dev;
+	vor_ctx_t *vor;
+	channelizer_t *chan;
+	channelizer_t *pendingChan;
 
-static int nearest_gain(int target_gain)
+	const dsp_kernels_t *dsp;
+	complex float Osc[DOWNSC];
+	int idx;
+	complex float D;
+	unsigned int skip;
+
+	int settling;
+	double level, prevLevel;
+	int count;
+
+	atomic_int resetPending;
+
+	settle_cb_t settleCb;
+	void *settleArg;
+	sample_cb_t sampleCb;
+	void *sampleArg;
+};
+
+static int nearest_gain(rtlsdr_dev_t *dev, int target_gain, int verbose)
 {
 	int i, err1, err2, count, close_gain;
 	int *gains;
@@ -50,93 +78,260 @@ static int nearest_gain(int target_gain)
 	return close_gain;
 }
 
-int initRtl(int dev_index, int fr)
+int rtlDeviceCount(void)
+{
+	return rtlsdr_get_device_count();
+}
+
+rtl_ctx_t *initRtl(int dev_index, int fr, const rtl_config_t *config, vor_ctx_t *vor)
 {
+	static const rtl_config_t defaults = RTL_CONFIG_DEFAULT;
 	int i, r, n;
+	rtl_ctx_t *ctx;
+
+	if (!config)
+		config = &defaults;
 
 	n = rtlsdr_get_device_count();
 	if (!n) {
 		fprintf(stderr, "No supported devices found.\n");
-		return -1;
+		return NULL;
 	}
 
-	if (verbose)
+	if (config->verbose)
 		fprintf(stderr, "Using device %d: %s\n",
 			dev_index, rtlsdr_get_device_name(dev_index));
 
-	r = rtlsdr_open(&dev, dev_index);
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+	ctx->vor = vor;
+
+	r = rtlsdr_open(&ctx->dev, dev_index);
 	if (r < 0) {
 		fprintf(stderr, "Failed to open rtlsdr device\n");
-		return r;
+		free(ctx);
+		return NULL;
 	}
 
-	rtlsdr_set_tuner_gain_mode(dev, 1);	/* no agc */
-	r = rtlsdr_set_tuner_gain(dev, nearest_gain(gain));
+	rtlsdr_set_tuner_gain_mode(ctx->dev, 1);	/* no agc */
+	r = rtlsdr_set_tuner_gain(ctx->dev, nearest_gain(ctx->dev, config->gain, config->verbose));
 	if (r < 0)
 		fprintf(stderr, "WARNING: Failed to set gain.\n");
 
-	if (ppm != 0) {
-		r = rtlsdr_set_freq_correction(dev, ppm);
+	if (config->ppm != 0) {
+		r = rtlsdr_set_freq_correction(ctx->dev, config->ppm);
 		if (r < 0)
 			fprintf(stderr,
 				"WARNING: Failed to set freq. correction\n");
 	}
 
-	r = rtlsdr_set_center_freq(dev, fr - IFFREQ);
+	r = rtlsdr_set_center_freq(ctx->dev, fr - IFFREQ);
 	if (r < 0) {
 		fprintf(stderr, "WARNING: Failed to set center freq.\n");
 	}
 
-	r = rtlsdr_set_sample_rate(dev, INRATE);
+	r = rtlsdr_set_sample_rate(ctx->dev, INRATE);
 	if (r < 0) {
 		fprintf(stderr, "WARNING: Failed to set sample rate.\n");
 	}
 
-	r = rtlsdr_reset_buffer(dev);
+	r = rtlsdr_reset_buffer(ctx->dev);
 	if (r < 0) {
 		fprintf(stderr, "WARNING: Failed to reset buffers.\n");
 	}
 
+	ctx->dsp = dspKernels();
 	for (i = 0; i < DOWNSC; i++) {
-		Osc[i] =
+		ctx->Osc[i] =
 		    cexpf(-I * i * 2 * M_PI * (float)IFFREQ / (float)INRATE);
 	}
 
-	return 0;
+	atomic_store(&ctx->resetPending, 1);
+	return ctx;
 }
 
-static void in_callback(unsigned char *rtlinbuff, unsigned int nread, void *ctx)
+void setSettleCallback(rtl_ctx_t *ctx, settle_cb_t cb, void *arg)
 {
-	static int idx = 0;
-	static complex float D = 0;
+	ctx->settleCb = cb;
+	ctx->settleArg = arg;
+}
 
-	unsigned int i;
+void setSampleCallback(rtl_ctx_t *ctx, sample_cb_t cb, void *arg)
+{
+	ctx->sampleCb = cb;
+	ctx->sampleArg = arg;
+}
+
+/* returns 1 once two consecutive blocks have the same mean level */
+static int levelSettled(rtl_ctx_t *ctx, float S)
+{
+	int stable;
+
+	ctx->level += S;
+	if (++ctx->count < SETTLE_BLOCK)
+		return 0;
+
+	ctx->level /= SETTLE_BLOCK;
+	stable = ctx->prevLevel > 0
+	    && fabs(ctx->level - ctx->prevLevel) < SETTLE_TOLERANCE * ctx->prevLevel;
+	ctx->prevLevel = ctx->level;
+	ctx->level = 0;
+	ctx->count = 0;
+	return stable;
+}
+
+static void checkSettled(float S, void *arg)
+{
+	rtl_ctx_t *ctx = arg;
+
+	if (ctx->settling && levelSettled(ctx, S)) {
+		ctx->settling = 0;
+		if (ctx->settleCb)
+			ctx->settleCb(ctx->settleArg);
+	}
+}
+
+/* one decimated sample: settling, the envelope block and the raw sample
+   callback */
+static void dump(rtl_ctx_t *ctx, float S, float *env, int *nenv, int size)
+{
+	checkSettled(S, ctx);
+	env[(*nenv)++] = S;
+	if (*nenv == size) {
+		vorProcessBlock(ctx->vor, env, *nenv);
+		*nenv = 0;
+	}
+	if (ctx->sampleCb)
+		ctx->sampleCb(S, ctx->sampleArg);
+}
+
+static void in_callback(unsigned char *rtlinbuff, unsigned int nread, void *arg)
+{
+	rtl_ctx_t *ctx = arg;
+	float env[INBUFSZ / 2 / DOWNSC];
+	float D[2 * DUMP_BLOCK];
+	int nenv = 0;
+	unsigned int i, n, k;
 
 	if (nread == 0) {
 		return;
 	}
 
+	if (atomic_exchange(&ctx->resetPending, 0)) {
+		ctx->idx = 0;
+		ctx->D = 0;
+		ctx->skip = RETUNE_SETTLE;
+		ctx->settling = 1;
+		ctx->level = ctx->prevLevel = 0;
+		ctx->count = 0;
+		ctx->chan = ctx->pendingChan;
+		if (ctx->chan)
+			chanReset(ctx->chan);
+		else
+			resetVor(ctx->vor);
+	}
+
+	if (ctx->skip) {
+		i = ctx->skip * 2 < nread ? ctx->skip * 2 : nread;
+		ctx->skip -= i / 2;
+		rtlinbuff += i;
+		nread -= i;
+	}
+
+	if (ctx->chan) {
+		/* channel envelopes are demodulated inside the channelizer;
+		   their mean level is used to detect settling */
+		chanPush(ctx->chan, rtlinbuff, nread, checkSettled, ctx);
+		return;
+	}
+
 	for (i = 0; i < nread;) {
 		float Is, Qs;
 
+		/* whole dumps go through the vector kernel, DUMP_BLOCK at a time;
+		   only a dump split across buffers is done a sample at a time */
+		if (ctx->idx == 0 && nread - i >= 2 * DOWNSC) {
+			n = (nread - i) / (2 * DOWNSC);
+			if (n > DUMP_BLOCK)
+				n = DUMP_BLOCK;
+			ctx->dsp->mixDecimate(rtlinbuff + i, (const float *)ctx->Osc, DOWNSC, D, n);
+			for (k = 0; k < n; k++)
+				dump(ctx, hypotf(D[2 * k], D[2 * k + 1]) / (float)DOWNSC / 128.0,
+				     env, &nenv, sizeof(env) / sizeof(env[0]));
+			i += n * 2 * DOWNSC;
+			continue;
+		}
+
 		Is = (float)rtlinbuff[i++] - 127.5;
 		Qs = (float)rtlinbuff[i++] - 127.5;
 
-		D += (Is + Qs * I) * Osc[idx];
-		idx++;
+		ctx->D += (Is + Qs * I) * ctx->Osc[ctx->idx];
+		ctx->idx++;
 
-		if (idx == DOWNSC) {
-			vor(cabs(D) / (float)DOWNSC / 128.0);
-			idx = 0;
-			D = 0;
+		if (ctx->idx == DOWNSC) {
+			dump(ctx, cabs(ctx->D) / (float)DOWNSC / 128.0,
+			     env, &nenv, sizeof(env) / sizeof(env[0]));
+			ctx->idx = 0;
+			ctx->D = 0;
 		}
 	}
+
+	vorProcessBlock(ctx->vor, env, nenv);
 }
 
-int runRtlSample(void)
+int runRtlSample(rtl_ctx_t *ctx)
 {
 	int r;
 
-	r = rtlsdr_read_async(dev, in_callback, NULL, 8, INBUFSZ);
+	r = rtlsdr_read_async(ctx->dev, in_callback, ctx, INBUFNUM, INBUFSZ);
 	return r;
-}
\ No newline at end of file
+}
+
+int retuneRtl(rtl_ctx_t *ctx, int fr)
+{
+	int r;
+
+	r = rtlsdr_set_center_freq(ctx->dev, fr - IFFREQ);
+	if (r < 0) {
+		fprintf(stderr, "WARNING: Failed to set center freq.\n");
+		return r;
+	}
+
+	ctx->pendingChan = NULL;
+	atomic_store(&ctx->resetPending, 1);
+	return 0;
+}
+
+/* the channelizer must stay alive until retunePending() reads 0 after
+   the next switch away from it */
+int retuneRtlWideband(rtl_ctx_t *ctx, int center, channelizer_t *chan)
+{
+	int r;
+
+	r = rtlsdr_set_center_freq(ctx->dev, center);
+	if (r < 0) {
+		fprintf(stderr, "WARNING: Failed to set center freq.\n");
+		return r;
+	}
+
+	ctx->pendingChan = chan;
+	atomic_store(&ctx->resetPending, 1);
+	return 0;
+}
+
+int retunePending(rtl_ctx_t *ctx)
+{
+	return atomic_load(&ctx->resetPending);
+}
+
+void stopRtl(rtl_ctx_t *ctx)
+{
+	rtlsdr_cancel_async(ctx->dev);
+}
+
+void closeRtl(rtl_ctx_t *ctx)
+{
+	rtlsdr_close(ctx->dev);
+	free(ctx);
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <signal.h>
@@ -8,12 +9,50 @@
 #include <complex.h>
 #include "vorify.h"
 
-extern int interval;
-
+/* four previous inputs and two previous outputs of a 4 zero, 2 pole
+   section; x1 and y1 are the most recent */
 typedef struct {
- complex double xv[8], yv[8];
+	complex double x1, x2, x3, x4, y1, y2;
 } filterstate_t;
 
+/* the 510Hz FM carrier filter has poles well inside the unit circle and
+   runs in single precision */
+typedef struct {
+	complex float x1, x2, x3, x4, y1, y2;
+} filterstatef_t;
+
+/* The 30Hz and 9960Hz oscillators repeat every LO_PERIOD samples (3 and 996
+   cycles). They are run as recursive rotators in single precision, restarted
+   from the exact phase of the sample count at every block so rounding never
+   accumulates. */
+#define LO_PERIOD 5000
+#define LO30_STEP 3
+#define LO9960_STEP 996
+
+/* DC gains of filterlow and filter510, to turn filtered levels back into
+   modulation depths */
+#define LOW_GAIN 22.2805
+#define GAIN510 1397.55
+
+/* The spread of the bearing is measured over sub-blocks of 0.1s, long
+   against the 15ms time constant of filterlow so their means are close to
+   independent. An early report needs at least MIN_SUBBLOCKS of them. */
+#define SUBBLOCK (FSINT/10)
+#define MIN_SUBBLOCKS 4
+
+/* A stream reports at most this often, over at most MAX_SLICES of its
+   reporting periods */
+#define MAX_STREAM_RATE 100
+#define MAX_SLICES 100
+
+/* sums over a run of samples */
+typedef struct {
+	double phase;			/* unwrapped */
+	double level, ref, sub, dev;	/* S, |ref30|^2, |fmcar|^2, |sig30|^2 */
+	double cs, sn;			/* cos, sin of the finished sub-block bearings */
+	int n, nsub;
+} sums_t;
+
 VORStation vorStations[] = {
     {"BEN GURION", 113.50, 32.0131, 34.8752, 100.0},
     {"BEER-SHEBA", 114.30, 31.2862, 34.7213, 853.0},
@@ -26,70 +65,279 @@ VORStation vorStations[] = {
 
 int numStations = sizeof(vorStations) / sizeof(vorStations[0]);
 
-static complex double filter510(complex double V , filterstate_t *st) {
-	st->xv[0] = st->xv[1]; st->xv[1] = st->xv[2]; st->xv[2] = st->xv[3]; st->xv[3] = st->xv[4]; 
-        st->xv[4] = V ;
-        st->yv[0] = st->yv[1]; st->yv[1] = st->yv[2]; st->yv[2] = st->yv[3]; st->yv[3] = st->yv[4]; 
-        st->yv[4] =   (st->xv[0] + st->xv[4]) +   1.3724127962 * (st->xv[1] + st->xv[3]) +   0.7448255925 * st->xv[2]
-                     + ( -0.9133512299 * st->yv[2]) + (  1.9094231878 * st->yv[3]);
-        return(st->yv[4]);
+static inline complex float filter510(complex float V, filterstatef_t *st)
+{
+	complex float y = (st->x4 + V) + 1.3724127962f * (st->x3 + st->x1) + 0.7448255925f * st->x2
+		+ (-0.9133512299f * st->y2) + (1.9094231878f * st->y1);
+	st->x4 = st->x3; st->x3 = st->x2; st->x2 = st->x1; st->x1 = V;
+	st->y2 = st->y1; st->y1 = y;
+	return y;
+}
+
+static inline complex double filterlow(complex double V, filterstate_t *st)
+{
+	complex double y = (st->x4 + V) + 0.0000142122 * (st->x3 + st->x1) - 1.9999715756 * st->x2
+		+ (-0.9972352026 * st->y2) + (1.9972326511 * st->y1);
+	st->x4 = st->x3; st->x3 = st->x2; st->x2 = st->x1; st->x1 = V;
+	st->y2 = st->y1; st->y1 = y;
+	return y;
 }
 
-static complex double filterlow(complex double V, filterstate_t *st) {
+struct vor_ctx {
+	filterstate_t flt_r;
+	filterstate_t flt_s;
+	filterstatef_t flt_f;
+	int lo;
+	double pA,uw;
+	complex float fpr;
+	int n;
+	long long clock;
+	sums_t w, cur;
+	int sublen;
+	int interval;
+	double target;
 
-	st->xv[0] = st->xv[1]; st->xv[1] = st->xv[2]; st->xv[2] = st->xv[3]; st->xv[3] = st->xv[4]; 
-        st->xv[4] = V ;
-        st->yv[0] = st->yv[1]; st->yv[1] = st->yv[2]; st->yv[2] = st->yv[3]; st->yv[3] = st->yv[4]; 
-        st->yv[4] =   (st->xv[0] + st->xv[4]) +   0.0000142122 * st->xv[1] +   0.0000142122 * st->xv[3]
-                     -   1.9999715756 * st->xv[2]
-                     + ( -0.9972352026 * st->yv[2]) + (  1.9972326511 * st->yv[3]);
-        return(st->yv[4]);
+	/* sliding window: the last slices sub-blocks, oldest at head */
+	int slices, head;
+	sums_t ring[MAX_SLICES];
+
+	bearing_cb_t cb;
+	void *arg;
+};
+
+vor_ctx_t *vorCreate(bearing_cb_t cb, void *arg)
+{
+	vor_ctx_t *ctx=malloc(sizeof(*ctx));
+	if(!ctx) return NULL;
+	ctx->cb=cb;
+	ctx->arg=arg;
+	ctx->interval=VOR_INTERVAL;
+	ctx->target=0;
+	ctx->slices=0;
+	ctx->sublen=SUBBLOCK;
+	resetVor(ctx);
+	return ctx;
 }
 
-void vor(float S)
+void vorDestroy(vor_ctx_t *ctx)
 {
-	static filterstate_t flt_r;
-	static filterstate_t flt_s;
-	static filterstate_t flt_f;
-	static double phase=0,sum=0,pA,uw=0;
-	static complex double fpr;
-	static int n=-FSINT/10;
+	free(ctx);
+}
+
+void vorSetInterval(vor_ctx_t *ctx, int seconds)
+{
+	ctx->interval=seconds;
+}
 
-	double A,fp,F;
-	complex double ref30,fmcar,sig30;
+void vorSetTarget(vor_ctx_t *ctx, double error)
+{
+	ctx->target=error;
+}
 
-	const double W30=2.0*M_PI*30/FSINT;
+void vorSetStream(vor_ctx_t *ctx, double rate, double window)
+{
+	if (rate <= 0) {
+		ctx->slices=0;
+		ctx->sublen=SUBBLOCK;
+	} else {
+		if (rate > MAX_STREAM_RATE) rate=MAX_STREAM_RATE;
+		ctx->sublen=lround(FSINT/rate);
+		ctx->slices=lround(window*rate);
+		if (ctx->slices < 1) ctx->slices=1;
+		if (ctx->slices > MAX_SLICES) ctx->slices=MAX_SLICES;
+	}
+	resetVor(ctx);
+}
 
-	phase+=W30;
-	if(phase>M_PI) phase-=2.0*M_PI;
+void resetVor(vor_ctx_t *ctx)
+{
+	memset(&ctx->flt_r,0,sizeof(ctx->flt_r));
+	memset(&ctx->flt_s,0,sizeof(ctx->flt_s));
+	memset(&ctx->flt_f,0,sizeof(ctx->flt_f));
+	memset(&ctx->w,0,sizeof(ctx->w));
+	memset(&ctx->cur,0,sizeof(ctx->cur));
+	memset(ctx->ring,0,sizeof(ctx->ring));
+	ctx->head=0;
+	ctx->lo=1;ctx->pA=0;ctx->uw=0;
+	ctx->fpr=0;
+	ctx->n=-FSINT/10;
+	ctx->clock=0;
+}
 
-	ref30=cexp(phase*-I)*S;	
-	ref30=filterlow(ref30,&flt_r);
+/* atan2 from an odd minimax polynomial on [0,1] and octant folding,
+   within 2e-6 rad. libm's atan2 was most of the per-sample cost. */
+static inline float fast_atan2f(float y, float x)
+{
+	float ax = fabsf(x), ay = fabsf(y);
+	float a = fminf(ax, ay) / fmaxf(fmaxf(ax, ay), 1e-30f);
+	float s = a * a;
+	float r = (((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s
+		- 0.33262347f) * s + 0.99997726f) * a;
 
-	fmcar=filter510(cexp(9960/30*phase*-I)*S,&flt_f);
-	F=carg(fmcar*conj(fpr));
-	fpr=fmcar;
-	if(F>2.0*M_PI*510/FSINT) F=2.0*M_PI*510/FSINT;
-	if(F<-2.0*M_PI*510/FSINT) F=-2.0*M_PI*510/FSINT;
+	r = ay > ax ? (float)M_PI_2 - r : r;
+	r = x < 0 ? (float)M_PI - r : r;
+	return copysignf(r, y);
+}
 
-	sig30=cexp(phase*-I)*F;
-	sig30=filterlow(sig30,&flt_s);
+static inline complex float lo(int step, int k)
+{
+	return cexpf(-I * (float)(2.0 * M_PI * (step * k % LO_PERIOD) / LO_PERIOD));
+}
 
-	A=carg(sig30*conj(ref30))+26*2.0*M_PI*30/FSINT;
-	if(n>0) {
-		if((A-pA)>M_PI) uw-=2.0*M_PI;
-		if((A-pA)<-M_PI) uw+=2.0*M_PI;
-		sum+=A+uw;
+static inline void addSums(sums_t *to, const sums_t *from)
+{
+	to->phase += from->phase;
+	to->level += from->level;
+	to->ref += from->ref;
+	to->sub += from->sub;
+	to->dev += from->dev;
+	to->cs += from->cs;
+	to->sn += from->sn;
+	to->n += from->n;
+	to->nsub += from->nsub;
+}
+
+/* standard error of the mean of the sub-block bearings, in radians */
+static inline double windowError(const sums_t *w)
+{
+	double R = sqrt(w->cs * w->cs + w->sn * w->sn) / w->nsub;
+
+	return R > 1e-9 ? sqrt(2 * log(1 / fmin(R, 1))) / sqrt(w->nsub) : M_PI;
+}
+
+/* reports the bearing over the samples summed in t, ending clock samples
+   after the last reset */
+static void report(vor_ctx_t *ctx, const sums_t *t, long long clock)
+{
+	vor_bearing_t b;
+	double carrier = t->level / t->n;
+	double R = t->nsub ? sqrt(t->cs * t->cs + t->sn * t->sn) / t->nsub : 0;
+
+	b.bearing = fmod(180.0 / M_PI * t->phase / t->n, 360.0);
+	if (b.bearing < 0) b.bearing += 360;
+	b.refDepth = 2 * sqrt(t->ref / t->n) / (LOW_GAIN * carrier);
+	b.subcarrierDepth = 2 * sqrt(t->sub / t->n) / (GAIN510 * carrier);
+	b.deviation = 2 * sqrt(t->dev / t->n) / LOW_GAIN * FSINT / (2 * M_PI);
+	b.variance = 1 - fmin(R, 1);
+	b.stddev = R > 1e-9 ? 180.0 / M_PI * sqrt(2 * log(1 / fmin(R, 1))) : 180;
+	b.error = b.stddev / sqrt(t->nsub ? t->nsub : 1);
+	b.seconds = (double)t->n / FSINT;
+	b.time = (double)clock / FSINT;
+	b.confident = ctx->target <= 0 || b.error <= ctx->target;
+
+	if (ctx->cb) ctx->cb(&b, ctx->arg);
+}
+
+/* Closes the sub-block in cur. A stream replaces its oldest slice with it
+   and reports over the whole ring; otherwise it joins the window in w. */
+static void endSubblock(vor_ctx_t *ctx, sums_t *w, sums_t *cur, long long clock)
+{
+	double m = cur->phase / cur->n;
+
+	cur->cs = cos(m);
+	cur->sn = sin(m);
+	cur->nsub = 1;
+
+	if (ctx->slices) {
+		sums_t t = { 0 };
+		int k;
+
+		ctx->ring[ctx->head] = *cur;
+		ctx->head = (ctx->head + 1) % ctx->slices;
+		for (k = 0; k < ctx->slices; k++)
+			addSums(&t, &ctx->ring[k]);
+		report(ctx, &t, clock);
+	} else {
+		addSums(w, cur);
 	}
-	pA=A;
-
-	n++;
-	if(n>interval*FSINT) {
-		double avg=fmod(180.0/M_PI*sum/n,360.0);
-		if(avg<0) avg+=360;
-		printf("%5.1f\n",avg);
-    fflush(stdout);
-		n=0;sum=0;
+	memset(cur, 0, sizeof(*cur));
+}
+
+void vorProcessBlock(vor_ctx_t *ctx, const float *S, int n)
+{
+	const float FMAX = 2.0 * M_PI * 510 / FSINT;
+	const double DELAY = 26 * 2.0 * M_PI * 30 / FSINT;
+
+	/* the filters and oscillators stay in locals for the whole block */
+	filterstate_t flt_r = ctx->flt_r, flt_s = ctx->flt_s;
+	filterstatef_t flt_f = ctx->flt_f;
+	complex float lo30 = lo(LO30_STEP, ctx->lo), rot30 = lo(LO30_STEP, 1);
+	complex float lo9960 = lo(LO9960_STEP, ctx->lo), rot9960 = lo(LO9960_STEP, 1);
+	complex float fpr = ctx->fpr;
+	double pA = ctx->pA, uw = ctx->uw;
+	double target = ctx->target * M_PI / 180.0;
+	sums_t w = ctx->w, cur = ctx->cur;
+	int count = ctx->n;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		complex double ref30, sig30, p;
+		complex float fmcar, d;
+		double A;
+		float F;
+
+		ref30 = filterlow(lo30 * S[i], &flt_r);
+
+		fmcar = filter510(lo9960 * S[i], &flt_f);
+		d = fmcar * conjf(fpr);
+		F = fast_atan2f(cimagf(d), crealf(d));
+		fpr = fmcar;
+		if (F > FMAX) F = FMAX;
+		if (F < -FMAX) F = -FMAX;
+
+		sig30 = filterlow(lo30 * F, &flt_s);
+
+		lo30 *= rot30;
+		lo9960 *= rot9960;
+
+		p = sig30 * conj(ref30);
+		A = fast_atan2f(cimag(p), creal(p)) + DELAY;
+		if (count > 0) {
+			if ((A - pA) > M_PI) uw -= 2.0 * M_PI;
+			if ((A - pA) < -M_PI) uw += 2.0 * M_PI;
+			cur.phase += A + uw;
+			cur.level += S[i];
+			cur.ref += creal(ref30) * creal(ref30) + cimag(ref30) * cimag(ref30);
+			cur.sub += crealf(fmcar) * crealf(fmcar) + cimagf(fmcar) * cimagf(fmcar);
+			cur.dev += creal(sig30) * creal(sig30) + cimag(sig30) * cimag(sig30);
+			if (++cur.n == ctx->sublen)
+				endSubblock(ctx, &w, &cur, ctx->clock + i + 1);
+		}
+		pA = A;
+
+		if (ctx->slices) {
+			/* a stream only counts out the warm-up; it reports from
+			   endSubblock and never closes its window */
+			if (count <= 0)
+				count++;
+			continue;
+		}
+
+		count++;
+
+		/* the window ends at the interval, or as soon as the bearing is
+		   known to the target error */
+		if (count > ctx->interval * FSINT
+		    || (cur.n == 0 && w.nsub >= MIN_SUBBLOCKS && target > 0
+			&& windowError(&w) <= target)) {
+			addSums(&w, &cur);
+			report(ctx, &w, ctx->clock + i + 1);
+			count = 0;
+			memset(&w, 0, sizeof(w));
+			memset(&cur, 0, sizeof(cur));
+		}
 	}
-}	
 
+	ctx->flt_r = flt_r; ctx->flt_s = flt_s; ctx->flt_f = flt_f;
+	ctx->fpr = fpr;
+	ctx->pA = pA; ctx->uw = uw;
+	ctx->w = w; ctx->cur = cur;
+	ctx->n = count;
+	ctx->clock += n;
+	ctx->lo = (ctx->lo + n) % LO_PERIOD;
+}
+
+void vor(vor_ctx_t *ctx, float S)
+{
+	vorProcessBlock(ctx, &S, 1);
+}
@@ -8,48 +8,82 @@
 #include <complex.h>
 #include "vorify.h"
 
-int verbose = 0;
-int interval=2;
-int freq ;
+static void sighandler(int signum);
 
-int initRtl(int dev_index, int fr);
-int runRtlSample(void);
-int devid = 0;
-int ppm = 0;
-int gain = 1000;
+/* what printBearing adds to each bearing, from -q and -s */
+typedef struct {
+	int quality;
+	int stream;
+} output_t;
 
-static void sighandler(int signum);
+static void printBearing(const vor_bearing_t *b, void *arg)
+{
+	const output_t *out = arg;
+
+	if (out->stream)
+		printf("%9.2f ", b->time);
+	if (out->quality)
+		printf("%5.1f err %.3f sd %.2f var %.4f ref %.3f sub %.3f dev %.0f %.1fs%s\n",
+		       b->bearing, b->error, b->stddev, b->variance, b->refDepth,
+		       b->subcarrierDepth, b->deviation, b->seconds,
+		       b->confident ? "" : " weak");
+	else
+		printf("%5.1f\n", b->bearing);
+	fflush(stdout);
+}
 
 static void usage(void)
 {
 	fprintf(stderr,
 		"vor receiver Copyright (c) 2018 Thierry Leconte \n\n");
-	fprintf(stderr, "Usage: vorify [-g gain] [-l interval ] [-p ppm] [-r device] frequency in MHz\n\n");
+	fprintf(stderr, "Usage: vorify [-g gain] [-l interval ] [-e error] [-s rate [-w window]] [-q] [-p ppm] [-r device] frequency in MHz\n\n");
 	fprintf(stderr, " -g gain :\t\t\tgain in tenth of db (ie : 500 = 50 db)\n");
 	fprintf(stderr, " -p ppm :\t\t\tppm freq shift\n");
 	fprintf(stderr, " -r n :\t\t\trtl device number\n");
 	fprintf(stderr, " -l interval :\t\t\ttime between two measurements\n");
+	fprintf(stderr, " -e error :\t\t\treport early once the bearing is known to error degrees\n");
+	fprintf(stderr, " -s rate :\t\t\tstream rate bearings a second, each after its time in seconds\n");
+	fprintf(stderr, " -w window :\t\t\tseconds averaged into each streamed bearing (default 1)\n");
+	fprintf(stderr, " -q :\t\t\t\tprint signal quality after each bearing\n");
 	exit(1);
 }
 
 int main(int argc, char **argv)
 {
-	int i, c;
+	int c, freq, devid = 0, interval = VOR_INTERVAL;
+	double target = 0, rate = 0, window = 1;
+	output_t out = { 0, 0 };
+	rtl_config_t config = RTL_CONFIG_DEFAULT;
 	struct sigaction sigact;
+	vor_ctx_t *vor;
+	rtl_ctx_t *rtl;
 
-	while ((c = getopt(argc, argv, "vg:l:p:r:h")) != EOF) {
+	while ((c = getopt(argc, argv, "vg:l:e:s:w:qp:r:h")) != EOF) {
 		switch ((char)c) {
 		case 'v':
-			verbose = 1;
+			config.verbose = 1;
 			break;
 		case 'l':
 			interval = atoi(optarg);
 			break;
+		case 'e':
+			target = atof(optarg);
+			break;
+		case 's':
+			rate = atof(optarg);
+			out.stream = rate > 0;
+			break;
+		case 'w':
+			window = atof(optarg);
+			break;
+		case 'q':
+			out.quality = 1;
+			break;
 		case 'g':
-			gain = atoi(optarg);
+			config.gain = atoi(optarg);
 			break;
 		case 'p':
-			ppm = atoi(optarg);
+			config.ppm = atoi(optarg);
 			break;
 		case 'r':
 			devid = atoi(optarg);
@@ -78,9 +112,14 @@ int main(int argc, char **argv)
 	sigaction(SIGTERM, &sigact, NULL);
 	sigaction(SIGQUIT, &sigact, NULL);
 
-	if (initRtl(devid, freq))
+	vor = vorCreate(printBearing, &out);
+	vorSetInterval(vor, interval);
+	vorSetTarget(vor, target);
+	vorSetStream(vor, rate, window);
+	rtl = initRtl(devid, freq, &config, vor);
+	if (!rtl)
 		exit(-1);
-	runRtlSample();
+	runRtlSample(rtl);
 
 	sighandler(0);
 	exit(0);
@@ -1,6 +1,13 @@
+#pragma once
 #define FSINT 50000
 
-extern int freq;
+// Seconds of samples averaged into each bearing unless vorSetInterval says
+// otherwise
+#define VOR_INTERVAL 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef struct {
     char name[100];       // Name of the VOR station
@@ -8,4 +15,105 @@ typedef struct {
     double latitude;      // Latitude in decimal degrees
     double longitude;     // Longitude in decimal degrees
     double elevation;     // Elevation in meters
-} VORStation;
\ No newline at end of file
+} VORStation;
+
+// One averaged bearing and the signal it was measured on. Depths are
+// relative to the carrier. The window is cut into 0.1s sub-blocks; their
+// spread gives the variance, and the error is the standard error of the
+// bearing that follows from it.
+typedef struct {
+    double bearing;          // degrees
+    double refDepth;         // AM depth of the 30Hz reference, nominally 0.3
+    double subcarrierDepth;  // AM depth of the 9960Hz subcarrier
+    double deviation;        // FM deviation of the subcarrier in Hz, nominally 480
+    double variance;         // circular variance of the sub-block bearings, 0..1
+    double stddev;           // circular standard deviation of the sub-blocks, degrees
+    double error;            // standard error of bearing, degrees
+    double seconds;          // length of the window averaged
+    double time;             // seconds of samples since the last reset at its end
+    int confident;           // error is within the vorSetTarget target, if any
+} vor_bearing_t;
+
+// Called with every averaged bearing the demodulator produces
+typedef void (*bearing_cb_t)(const vor_bearing_t *bearing, void *arg);
+
+// Called once the carrier level is stable after a retune
+typedef void (*settle_cb_t)(void *arg);
+
+// Called with every 50kHz AM envelope sample fed to the demodulator
+typedef void (*sample_cb_t)(float S, void *arg);
+
+// Demodulator state for one station; one per concurrently decoded signal
+typedef struct vor_ctx vor_ctx_t;
+
+vor_ctx_t *vorCreate(bearing_cb_t cb, void *arg);
+void vorDestroy(vor_ctx_t *ctx);
+void vorSetInterval(vor_ctx_t *ctx, int seconds);
+// Reports as soon as the standard error of bearing is within error degrees,
+// instead of only at the end of every interval; 0 turns this off
+void vorSetTarget(vor_ctx_t *ctx, double error);
+// Reports rate times a second over the last window seconds instead, with
+// overlapping windows and no gaps; each reporting period is one sub-block.
+// A rate of 0 goes back to one report per interval. Resets the demodulator.
+void vorSetStream(vor_ctx_t *ctx, double rate, double window);
+void resetVor(vor_ctx_t *ctx);
+void vor(vor_ctx_t *ctx, float S);
+// Demodulates n consecutive 50kHz envelope samples; same as n calls to vor()
+void vorProcessBlock(vor_ctx_t *ctx, const float *S, int n);
+
+// Worker threads that demodulate many contexts at once. A context is only
+// run by one thread at a time, but different contexts' bearing callbacks
+// can run concurrently.
+typedef struct vor_pool vor_pool_t;
+
+vor_pool_t *poolCreate(int threads);
+void poolDestroy(vor_pool_t *pool);
+// Runs vorProcessBlock(ctx[k], S[k], n) for every k < count and returns once
+// all are done. Several S[k] may point to the same stream. The caller works
+// through the batch too, and several callers can share one pool.
+void poolRun(vor_pool_t *pool, vor_ctx_t **ctx, const float **S, int count, int n);
+// Process-wide pool with a thread for each core beyond the first
+vor_pool_t *sharedPool(void);
+
+// Splits one capture into 50kHz channels, each feeding its own demodulator.
+// Channels sit up to MAX_CHANNEL_BIN * FSINT either side of the tuner, short
+// of where the RTL front end rolls off.
+#define MAX_CHANNELS 36
+#define MAX_CHANNEL_BIN 18
+
+typedef struct channelizer channelizer_t;
+
+channelizer_t *chanCreate(void);
+void chanDestroy(channelizer_t *chan);
+int chanAdd(channelizer_t *chan, int offset, vor_ctx_t *vor);
+void chanReset(channelizer_t *chan);
+void chanPush(channelizer_t *chan, const unsigned char *buf, unsigned int len,
+              sample_cb_t cb, void *arg);
+
+// One open RTL device feeding one demodulator, or a channelizer
+typedef struct rtl_ctx rtl_ctx_t;
+
+// Tuner settings for initRtl; gain is in tenths of a dB
+typedef struct {
+    int gain;
+    int ppm;
+    int verbose;
+} rtl_config_t;
+
+#define RTL_CONFIG_DEFAULT { 1000, 0, 0 }
+
+int rtlDeviceCount(void);
+// config may be NULL for RTL_CONFIG_DEFAULT
+rtl_ctx_t *initRtl(int dev_index, int fr, const rtl_config_t *config, vor_ctx_t *vor);
+void setSettleCallback(rtl_ctx_t *ctx, settle_cb_t cb, void *arg);
+void setSampleCallback(rtl_ctx_t *ctx, sample_cb_t cb, void *arg);
+int runRtlSample(rtl_ctx_t *ctx);
+int retuneRtl(rtl_ctx_t *ctx, int fr);
+int retuneRtlWideband(rtl_ctx_t *ctx, int center, channelizer_t *chan);
+int retunePending(rtl_ctx_t *ctx);
+void stopRtl(rtl_ctx_t *ctx);
+void closeRtl(rtl_ctx_t *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,10 +9,38 @@
 #include <bluetooth/hci_lib.h>
 #include <bluetooth/sdp.h>
 #include <bluetooth/sdp_lib.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <errno.h>
+
+// Sentences read from stdin are fanned out to every connected client. Each
+// client has its own ring buffer; when a client stops reading, its oldest
+// sentences are dropped to make room, so a stalled tablet never delays the
+// others. The listening socket is RFCOMM by default, or a Unix or TCP socket
+// for testing without Bluetooth hardware:
+//
+//   bluetooth-server
+//   bluetooth-server unix PATH
+//   bluetooth-server tcp PORT
+
+#define MAX_CLIENTS 16
+#define RING_SIZE 8192   // bytes queued per client, about 2 s of 10 Hz output
+#define LINE_SIZE 256
+
+struct client {
+  int fd;
+  char ring[RING_SIZE];
+  size_t head;           // offset of the oldest queued byte
+  size_t length;         // bytes queued
+  unsigned long dropped; // sentences dropped since the last report
+  int want_write;        // EPOLLOUT is armed
+};
 
 static int server_socket = -1;
-static int client_socket = -1;
+static int epoll_fd = -1;
+static struct client clients[MAX_CLIENTS];
 
 sdp_session_t *register_service(uint8_t rfcomm_channel) {
   uuid_t root_uuid, l2cap_uuid, rfcomm_uuid, svc_uuid;
@@ -98,6 +126,14 @@ void make_device_discoverable() {
   printf("Bluetooth device is now discoverable.\n");
 }
 
+static void set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    perror("Failed to make socket non-blocking");
+    exit(EXIT_FAILURE);
+  }
+}
+
 void bluetooth_init(const char *device_name) {
   struct sockaddr_rc loc_addr = { 0 };
 
@@ -137,116 +173,314 @@ void bluetooth_init(const char *device_name) {
   }
 
   register_service(loc_addr.rc_channel);
+}
+
+void unix_init(const char *path) {
+  struct sockaddr_un addr = { 0 };
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  server_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server_socket < 0) {
+    perror("Failed to create Unix socket");
+    exit(EXIT_FAILURE);
+  }
+
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if (bind(server_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("Failed to bind Unix socket");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void tcp_init(int port) {
+  struct sockaddr_in addr = { 0 };
+  int reuse = 1;
 
-  // Start listening for incoming connections
-  if (listen(server_socket, 1) < 0) {
-    perror("Failed to listen on Bluetooth socket");
+  server_socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (server_socket < 0) {
+    perror("Failed to create TCP socket");
     exit(EXIT_FAILURE);
   }
+  setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
-  printf("Bluetooth server initialized. Waiting for connection...\n");
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(server_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("Failed to bind TCP socket");
+    exit(EXIT_FAILURE);
+  }
+}
 
-  // Accept a connection from a client
-  struct sockaddr_rc rem_addr = { 0 };
-  socklen_t opt = sizeof(rem_addr);
-  client_socket = accept(server_socket, (struct sockaddr *)&rem_addr, &opt);
-  if (client_socket < 0) {
-    perror("Failed to accept Bluetooth connection");
+static void watch(int fd, uint32_t events, int op) {
+  struct epoll_event event = { 0 };
+  event.events = events;
+  event.data.fd = fd;
+  if (epoll_ctl(epoll_fd, op, fd, &event) < 0) {
+    perror("epoll_ctl");
     exit(EXIT_FAILURE);
   }
+}
+
+static struct client *find_client(int fd) {
+  for (int i = 0; i < MAX_CLIENTS; ++i) {
+    if (clients[i].fd == fd) {
+      return &clients[i];
+    }
+  }
+  return NULL;
+}
 
-  char client_address[18] = { 0 };
-  ba2str(&rem_addr.rc_bdaddr, client_address);
-  printf("Accepted connection from %s\n", client_address);
+static void client_close(struct client *c) {
+  printf("Client %d disconnected\n", c->fd);
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  c->fd = -1;
 }
 
-void bluetooth_send(const char *data) {
-    if (client_socket < 0) {
-        fprintf(stderr, "No client connected. Cannot send data.\n");
-        return;
+static void client_accept() {
+  while (1) {
+    int fd = accept(server_socket, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("Failed to accept connection");
+      }
+      return;
     }
 
-    ssize_t sent = write(client_socket, data, strlen(data));
-    if (sent <= 0) {
-        perror("Send failed — assuming client disconnected");
-        close(client_socket);
-        client_socket = -1;
+    struct client *c = find_client(-1);
+    if (!c) {
+      fprintf(stderr, "Too many clients, refusing connection\n");
+      close(fd);
+      continue;
     }
+
+    set_nonblocking(fd);
+    c->fd = fd;
+    c->head = 0;
+    c->length = 0;
+    c->dropped = 0;
+    c->want_write = 0;
+    watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+    printf("Client %d connected\n", fd);
+  }
 }
 
-void bluetooth_stop() {
-  if (client_socket >= 0) {
-    close(client_socket);
-    client_socket = -1;
+// Writes as much of the queue as the socket takes and arms EPOLLOUT while
+// anything is left
+static void client_flush(struct client *c) {
+  while (c->length > 0) {
+    size_t chunk = c->length;
+    if (c->head + chunk > RING_SIZE) {
+      chunk = RING_SIZE - c->head;
+    }
+    ssize_t sent = send(c->fd, c->ring + c->head, chunk, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      client_close(c);
+      return;
+    }
+    c->head = (c->head + sent) % RING_SIZE;
+    c->length -= sent;
   }
-  if (server_socket >= 0) {
-    close(server_socket);
-    server_socket = -1;
+
+  int want_write = c->length > 0;
+  if (want_write != c->want_write) {
+    watch(c->fd, want_write ? EPOLLIN | EPOLLOUT : EPOLLIN, EPOLL_CTL_MOD);
+    c->want_write = want_write;
   }
-  printf("Bluetooth server stopped.\n");
 }
 
-void bluetooth_wait_for_client() {
-    if (client_socket >= 0) {
-        close(client_socket);
-        client_socket = -1;
+// Drops whole sentences from the front of the queue until length bytes fit.
+// If the client already has the start of the front sentence, the rest of it
+// goes too; NMEA readers discard the truncated line on its checksum.
+static void client_make_room(struct client *c, size_t length) {
+  while (RING_SIZE - c->length < length) {
+    size_t i = 0;
+    while (i < c->length && c->ring[(c->head + i) % RING_SIZE] != '\n') {
+      ++i;
     }
+    i = i < c->length ? i + 1 : c->length;
+    c->head = (c->head + i) % RING_SIZE;
+    c->length -= i;
+    c->dropped++;
+  }
+}
 
-    struct sockaddr_rc rem_addr = { 0 };
-    socklen_t opt = sizeof(rem_addr);
+static void client_queue(struct client *c, const char *data, size_t length) {
+  if (c->length == 0 && c->dropped > 0) {
+    printf("Client %d caught up after dropping %lu sentences\n", c->fd, c->dropped);
+    c->dropped = 0;
+  }
+  client_make_room(c, length);
+  size_t tail = (c->head + c->length) % RING_SIZE;
+  size_t first = length < RING_SIZE - tail ? length : RING_SIZE - tail;
+  memcpy(c->ring + tail, data, first);
+  memcpy(c->ring, data + first, length - first);
+  c->length += length;
+}
 
-    printf("Waiting for Bluetooth client...\n");
-    client_socket = accept(server_socket, (struct sockaddr *)&rem_addr, &opt);
-    if (client_socket < 0) {
-        perror("Failed to accept Bluetooth connection");
-        return;
+static void broadcast(const char *sentence, size_t length) {
+  for (int i = 0; i < MAX_CLIENTS; ++i) {
+    if (clients[i].fd >= 0) {
+      client_queue(&clients[i], sentence, length);
+      client_flush(&clients[i]);
     }
+  }
+}
 
-    char client_address[18] = { 0 };
-    ba2str(&rem_addr.rc_bdaddr, client_address);
-    printf("Accepted connection from %s\n", client_address);
+// Clients are not expected to say anything; reading only notices hangups
+static void client_read(struct client *c) {
+  char discard[256];
+  while (1) {
+    ssize_t got = recv(c->fd, discard, sizeof(discard), 0);
+    if (got > 0) {
+      continue;
+    }
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    client_close(c);
+    return;
+  }
 }
 
-int main() {
-  char gps_data[256];
+// Splits stdin into sentences and sends each terminated by CRLF. Returns 0
+// once stdin is closed.
+static int read_stdin(char *line, size_t *line_length) {
+  char chunk[4096];
+  ssize_t got = read(STDIN_FILENO, chunk, sizeof(chunk));
+  if (got < 0) {
+    return errno == EAGAIN || errno == EINTR;
+  }
+  if (got == 0) {
+    return 0;
+  }
 
-  // Initialize the Bluetooth server
-  bluetooth_init("MockGPS");
+  for (ssize_t i = 0; i < got; ++i) {
+    char ch = chunk[i];
+    if (ch == '\r') {
+      continue;
+    }
+    if (ch != '\n') {
+      if (*line_length < LINE_SIZE - 2) {
+        line[(*line_length)++] = ch;
+      }
+      continue;
+    }
+    if (*line_length > 0) {
+      line[(*line_length)++] = '\r';
+      line[(*line_length)++] = '\n';
+      broadcast(line, *line_length);
+    }
+    *line_length = 0;
+  }
+  return 1;
+}
 
-  while (1) {
-    if (client_socket < 0) {
-      bluetooth_wait_for_client();
-      continue;  // go back to top so we don't send without a client
+void server_stop() {
+  for (int i = 0; i < MAX_CLIENTS; ++i) {
+    if (clients[i].fd >= 0) {
+      close(clients[i].fd);
+      clients[i].fd = -1;
     }
+  }
+  if (server_socket >= 0) {
+    close(server_socket);
+    server_socket = -1;
+  }
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+    epoll_fd = -1;
+  }
+  printf("Server stopped.\n");
+}
 
-    fd_set readfds;
-    struct timeval tv;
-    FD_ZERO(&readfds);
-    FD_SET(STDIN_FILENO, &readfds);
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
+int main(int argc, char *argv[]) {
+  char line[LINE_SIZE];
+  size_t line_length = 0;
+
+  if (argc == 3 && strcmp(argv[1], "unix") == 0) {
+    unix_init(argv[2]);
+  } else if (argc == 3 && strcmp(argv[1], "tcp") == 0) {
+    tcp_init(atoi(argv[2]));
+  } else if (argc == 1) {
+    bluetooth_init("MockGPS");
+  } else {
+    fprintf(stderr, "Usage: %s [unix PATH | tcp PORT]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
 
-    int retval = select(STDIN_FILENO + 1, &readfds, NULL, NULL, &tv);
+  if (listen(server_socket, MAX_CLIENTS) < 0) {
+    perror("Failed to listen");
+    exit(EXIT_FAILURE);
+  }
+  set_nonblocking(server_socket);
+  set_nonblocking(STDIN_FILENO);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  for (int i = 0; i < MAX_CLIENTS; ++i) {
+    clients[i].fd = -1;
+  }
 
-    if (retval == -1) {
-      perror("select()");
+  epoll_fd = epoll_create1(0);
+  if (epoll_fd < 0) {
+    perror("epoll_create1");
+    exit(EXIT_FAILURE);
+  }
+  watch(server_socket, EPOLLIN, EPOLL_CTL_ADD);
+  watch(STDIN_FILENO, EPOLLIN, EPOLL_CTL_ADD);
+  printf("Server initialized. Waiting for connections...\n");
+
+  int running = 1;
+  while (running) {
+    struct epoll_event events[MAX_CLIENTS + 2];
+    int count = epoll_wait(epoll_fd, events, MAX_CLIENTS + 2, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
       break;
-    } else if (retval) {
-      if (fgets(gps_data, sizeof(gps_data), stdin) != NULL) {
-        size_t len = strlen(gps_data);
-        if (len > 0 && gps_data[len - 1] == '\n') {
-          gps_data[len - 1] = '\0';
-        }
+    }
 
-        printf("Sending from stdin: %s\n", gps_data);
-        char with_crlf[260];
-        snprintf(with_crlf, sizeof(with_crlf), "%s\r\n", gps_data);
-        bluetooth_send(with_crlf);
+    for (int i = 0; i < count; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == server_socket) {
+        client_accept();
+      } else if (fd == STDIN_FILENO) {
+        running = read_stdin(line, &line_length);
+      } else {
+        struct client *c = find_client(fd);
+        if (!c) {
+          continue;
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          client_close(c);
+          continue;
+        }
+        if (events[i].events & EPOLLIN) {
+          client_read(c);
+        }
+        if (c->fd >= 0 && (events[i].events & EPOLLOUT)) {
+          client_flush(c);
+        }
       }
     }
   }
 
-  bluetooth_stop();
+  server_stop();
   return 0;
 }
-
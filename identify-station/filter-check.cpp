@@ -0,0 +1,75 @@
+/*
+ * Checks the front-end filters against direct convolution in double on
+ * random input fed in random block lengths, so history and decimation phase
+ * are carried across every kind of block boundary. Prints the worst error
+ * of each filter and exits 1 if any is out of tolerance.
+ */
+#include <iostream>
+#include <random>
+#include <cmath>
+#include "filters.h"
+
+using namespace std;
+
+// As identify-station runs the decimator
+constexpr float SAMPLE_RATE = 1800000.0f;
+constexpr float CUTOFF = 3000.0f;
+constexpr size_t FACTOR = 40;
+constexpr size_t MAX_BLOCK = 8192;
+constexpr int BLOCKS = 500;
+
+// Float accumulation over 101 taps of inputs in [-1, 1]
+constexpr double TOLERANCE = 1e-5;
+
+static bool report(const char *name, double error, size_t outputs) {
+  bool ok = error <= TOLERANCE;
+  cout << name << ": " << outputs << " outputs, max error " << error << (ok ? "" : "  FAILED") << endl;
+  return ok;
+}
+
+// Every FACTOR-th output of the full-rate filter, counted from the first input
+static bool checkDecimatingLowPass(mt19937& rng) {
+  vector<float> h(LOWPASS_TAPS);
+  liquid_firdes_kaiser(LOWPASS_TAPS, CUTOFF / (SAMPLE_RATE / 2), 60.0f, 0.0f, h.data());
+
+  DecimatingLowPass filter(CUTOFF, SAMPLE_RATE, FACTOR, MAX_BLOCK);
+  uniform_real_distribution<float> sample(-1.0f, 1.0f);
+  vector<float> input, out(MAX_BLOCK / FACTOR + 1);
+  size_t outputs = 0;
+  double error = 0;
+
+  for (int b = 0; b < BLOCKS; b++) {
+    size_t n = rng() % (MAX_BLOCK + 1);
+    float *block = filter.input();
+    for (size_t k = 0; k < n; k++) {
+      block[k] = sample(rng);
+      input.push_back(block[k]);
+    }
+
+    size_t count = filter.decimate(n, out.data());
+    for (size_t m = 0; m < count; m++, outputs++) {
+      size_t i = outputs * FACTOR;
+      if (i >= input.size()) {
+        return report("DecimatingLowPass", INFINITY, outputs);
+      }
+      double expected = 0;
+      for (size_t k = 0; k < LOWPASS_TAPS && k <= i; k++) {
+        expected += h[k] * input[i - k];
+      }
+      error = fmax(error, fabs(out[m] - expected));
+    }
+  }
+
+  // Every output the input completes, and no more
+  if (outputs != (input.size() + FACTOR - 1) / FACTOR) {
+    cout << "DecimatingLowPass: " << outputs << " outputs from " << input.size() << " inputs  FAILED" << endl;
+    return false;
+  }
+  return report("DecimatingLowPass", error, outputs);
+}
+
+int main() {
+  mt19937 rng(1);
+  bool ok = checkDecimatingLowPass(rng);
+  return ok ? 0 : 1;
+}
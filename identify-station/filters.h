@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <liquid/liquid.h>
+
+// Filters of the identify-station front end, kept apart from the RTL and
+// audio code so filter-check can run them on synthetic input
+
+using namespace std;
+
+#define LOWPASS_TAPS 101      // Taps of the decimating low-pass
+
+// Low-pass FIR that keeps one output in every `factor` inputs and computes
+// only those, each as one dot product of the taps with the inputs ending at
+// it. History and decimation phase carry over from block to block, and all
+// memory is allocated up front for blocks of up to maxBlock inputs.
+class DecimatingLowPass {
+  size_t factor;
+  size_t phase = 0;       // block index of the newest input of the next output
+  vector<float> taps;     // time-reversed, so an output is a forward dot product
+  vector<float> window;   // the last LOWPASS_TAPS - 1 inputs, then the block
+
+  public:
+  DecimatingLowPass(float cutoff, float fs, size_t factor, size_t maxBlock)
+    : factor(factor), taps(LOWPASS_TAPS), window(LOWPASS_TAPS - 1 + maxBlock, 0.0f) {
+    vector<float> h(LOWPASS_TAPS);
+    liquid_firdes_kaiser(LOWPASS_TAPS, cutoff / (fs / 2), 60.0f, 0.0f, h.data());
+    reverse_copy(h.begin(), h.end(), taps.begin());
+  }
+
+  // Where the next block of inputs is to be written
+  float *input() {
+    return window.data() + LOWPASS_TAPS - 1;
+  }
+
+  // Filters the n inputs written at input() and stores the outputs they
+  // complete in out; returns how many there were
+  size_t decimate(size_t n, float *out) {
+    size_t count = 0;
+    size_t j = phase;
+    for (; j < n; j += factor) {
+      const float *x = window.data() + j;
+      float sum = 0;
+      for (int k = 0; k < LOWPASS_TAPS; k++) {
+        sum += taps[k] * x[k];
+      }
+      out[count++] = sum;
+    }
+    phase = j - n;
+
+    copy(window.begin() + n, window.begin() + n + LOWPASS_TAPS - 1, window.begin());
+    return count;
+  }
+};
@@ -18,12 +18,16 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include "dsp_kernels.h"
+#include "filters.h"
 
 
 #define SAMPLE_RATE 1800000   // RTL-SDR sample rate
 #define DECIMATION 40         // Reduce sample rate to ~51.2 kHz
 #define AUDIO_RATE 48000      // Target audio sample rate
 #define BUFFER_SIZE 16384     // Buffer size for async read
+#define LOWPASS_CUTOFF 3000.0f // Cutoff of the decimating low-pass
 
 // Adjustable Morse timing parameters
 #define DOT_DURATION 50    // Dot duration in milliseconds
@@ -39,10 +43,17 @@ constexpr int MIN_DURATION_SAMPLES = PCM_RATE * MIN_DURATION_MS / 1000;
 constexpr double LOW_FREQ = 900.0;
 constexpr double HIGH_FREQ = 1100.0;
 
+// Goertzel power, divided by the squared buffer length, above which the tone
+// is on. The detector was tuned at a raw power of 4 when the band-pass zeroed
+// the first FIR_ORDER outputs of each 205-sample buffer. This is the level a
+// steady 1020 Hz ident of the same amplitude reaches now that all 205 are
+// filtered: 4 / 104^2, less 2 dB for the narrower Goertzel bins. Noise power
+// grows only with the length, so noise falls about 1 dB further below it.
+constexpr double TONE_POWER = 2.3e-4;
+
 #include "fir_coeffs_900_1100Hz.h"
 
 rtlsdr_dev_t *dev = nullptr;
-firfilt_rrrf filter;
 
 int squelch_threshold = 20;  // Default squelch threshold (1-100)
 string station_id = "";
@@ -66,67 +77,47 @@ auto last_tone_start = chrono::steady_clock::now();
 auto last_tone_end = chrono::steady_clock::now();
 double silence_duration;// = chrono::duration_cast<chrono::milliseconds>;
 
-// Create Low-pass FIR filter using liquid-dsp
-void createLowPassFilter(float cutoff, float fs) {
-  int filter_order = 101;
-  filter = firfilt_rrrf_create_kaiser(filter_order, cutoff / (fs / 2), 60.0f, 0.0f);
-}
+// State of the I/Q front end between USB buffers: a decimator per stream,
+// the AGC gain and buffers for one block's outputs
+struct FrontEnd {
+  static constexpr size_t BLOCK = BUFFER_SIZE / 2;
+  static constexpr size_t OUTPUTS = (BLOCK + DECIMATION - 1) / DECIMATION;
+
+  DecimatingLowPass i_filter{LOWPASS_CUTOFF, SAMPLE_RATE, DECIMATION, BLOCK};
+  DecimatingLowPass q_filter{LOWPASS_CUTOFF, SAMPLE_RATE, DECIMATION, BLOCK};
+  array<float, OUTPUTS> i_samples;
+  array<float, OUTPUTS> q_samples;
+  vector<int16_t> pcm;
+  float gain = 1.0f;
+};
 
-// Low-pass FIR filter using liquid-dsp
-void lowPassFilter(vector<float> &signal) {
-  for (size_t i = 0; i < signal.size(); i++) {
-    firfilt_rrrf_push(filter, signal[i]);
-    firfilt_rrrf_execute(filter, &signal[i]);
-  }
-}
+// Streaming band-pass over fir_coeffs. The last FIR_ORDER - 1 inputs carry
+// over, so every output sees a full window and blocks join up without a gap;
+// blocks of up to maxBlock inputs run without allocating.
+class FIRFilter {
+  vector<float> taps;     // time-reversed, as the fir kernel takes them
+  vector<float> window;   // the last FIR_ORDER - 1 inputs, then the block
+  size_t maxBlock;
 
-// Simple FIR filter function
-vector<double> apply_fir_filter(const vector<double>& input) {
-  vector<double> output(input.size(), 0);
-  for (size_t i = FIR_ORDER; i < input.size(); ++i) {
-    double sum = 0;
-    for (size_t j = 0; j < FIR_ORDER; ++j) {
-      sum += input[i - j] * fir_coeffs[j];
-    }
-    output[i] = sum;
+  public:
+  explicit FIRFilter(size_t maxBlock)
+    : taps(FIR_ORDER), window(FIR_ORDER - 1 + maxBlock, 0.0f), maxBlock(maxBlock) {
+    reverse_copy(fir_coeffs, fir_coeffs + FIR_ORDER, taps.begin());
   }
-  return output;
-}
 
-// Simple Hamming-windowed FIR band-pass filter (900–1100 Hz)
-class FIRFilter {
-  static constexpr int TAPS = 101;
-  array<double, TAPS> coeffs;
-  vector<int16_t> history;
-  int pos = 0;
+  size_t capacity() const {
+    return maxBlock;
+  }
 
-  public:
-  FIRFilter() : history(TAPS, 0) {
-    double fc_low = LOW_FREQ / PCM_RATE;
-    double fc_high = HIGH_FREQ / PCM_RATE;
-
-    for (int i = 0; i < TAPS; i++) {
-      int m = i - (TAPS - 1) / 2;
-      if (m == 0) {
-        coeffs[i] = 2 * (fc_high - fc_low);
-      } else {
-        coeffs[i] = (sin(2 * M_PI * fc_high * m) - sin(2 * M_PI * fc_low * m)) / (M_PI * m);
-      }
-      // Apply Hamming window
-      coeffs[i] *= 0.54 - 0.46 * cos(2 * M_PI * i / (TAPS - 1));
-    }
+  // Where the next block of inputs is to be written
+  float *input() {
+    return window.data() + FIR_ORDER - 1;
   }
 
-  double process(int16_t sample) {
-    history[pos] = sample;
-    double output = 0;
-    int j = pos;
-    for (int i = 0; i < TAPS; i++) {
-      output += coeffs[i] * history[j];
-      j = (j - 1 + TAPS) % TAPS;
-    }
-    pos = (pos + 1) % TAPS;
-    return output;
+  // Filters the n inputs written at input() into out
+  void process(size_t n, float *out) {
+    dspKernels()->fir(taps.data(), FIR_ORDER, window.data(), out, n);
+    copy(window.begin() + n, window.begin() + n + FIR_ORDER - 1, window.begin());
   }
 };
 
@@ -145,9 +136,9 @@ class GoertzelDetector {
     s_prev = s_prev2 = 0;
   }
 
-  void process(const vector<double>& buffer) {
-    reset();
-    for (double sample : buffer) {
+  void process(const float *buffer, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      double sample = buffer[i];
       double s = sample + coeff * s_prev - s_prev2;
       s_prev2 = s_prev;
       s_prev = s;
@@ -163,6 +154,8 @@ class GoertzelDetector {
 class ToneDetector {
   GoertzelDetector goertzel_low;
   GoertzelDetector goertzel_high;
+  FIRFilter band_pass;
+  vector<float> filtered_signal;
   chrono::steady_clock::time_point start_time;
   bool tone_active = false;
   int active_samples = 0;
@@ -171,30 +164,39 @@ class ToneDetector {
   public:
   ToneDetector(int sample_rate, int buffer_size)
     : goertzel_low(LOW_FREQ, sample_rate, buffer_size),
-    goertzel_high(HIGH_FREQ, sample_rate, buffer_size) {
+    goertzel_high(HIGH_FREQ, sample_rate, buffer_size),
+    band_pass(buffer_size),
+    filtered_signal(buffer_size) {
       start_time = chrono::steady_clock::now();
     }
 
   void process_buffer(const vector<int16_t>& buffer) {
-    vector<double> normalized_buffer(buffer.size());
     static char idCode[10] = "         ";
     static int idInx = 0;
 
-    // Normalize PCM values to [-1,1]
-    for (size_t i = 0; i < buffer.size(); ++i) {
-      normalized_buffer[i] = buffer[i] / 32768.0;
-    }
+    goertzel_low.reset();
+    goertzel_high.reset();
+    for (size_t start = 0, n; start < buffer.size(); start += n) {
+      n = min(buffer.size() - start, band_pass.capacity());
 
-    // Apply FIR band-pass filter
-    vector<double> filtered_signal = apply_fir_filter(normalized_buffer);
+      // Normalize PCM values to [-1,1] straight into the filter
+      float *normalized = band_pass.input();
+      for (size_t i = 0; i < n; ++i) {
+        normalized[i] = buffer[start + i] / 32768.0f;
+      }
+
+      // Apply FIR band-pass filter
+      band_pass.process(n, filtered_signal.data());
 
-    // Compute Goertzel power
-    goertzel_low.process(filtered_signal);
-    goertzel_high.process(filtered_signal);
+      // Compute Goertzel power
+      goertzel_low.process(filtered_signal.data(), n);
+      goertzel_high.process(filtered_signal.data(), n);
+    }
 
     double power_low = goertzel_low.get_power();
     double power_high = goertzel_high.get_power();
-    double power = power_low + power_high;
+    double samples = max<size_t>(buffer.size(), 1);
+    double power = (power_low + power_high) / (samples * samples);
 
     // Adaptive noise floor update
     //        noise_floor = 0.99 * noise_floor + 0.01 * power;
@@ -202,7 +204,7 @@ class ToneDetector {
     //        cout << "Power low: " << power_low << "Power high: " << power_high << " Total power: " << power << "\n";
     //        bool detected = power > (noise_floor * 4.0);
 
-    bool detected = power > 4;
+    bool detected = power > TONE_POWER;
     if (detected) {
       active_samples += buffer.size();
       if (!tone_active && active_samples >= MIN_DURATION_SAMPLES) {
@@ -258,50 +260,47 @@ class ToneDetector {
 
 void processIQ(uint8_t *iq_buffer, uint32_t length, int squelch_threshold) {
   static ToneDetector detector(PCM_RATE, length);
+  static FrontEnd fe;
   size_t num_samples = length / 2;
-  vector<float> i_samples(num_samples), q_samples(num_samples), am_signal(num_samples / DECIMATION);
-
-  // Convert IQ samples to floating point values
-  for (size_t i = 0; i < num_samples; i++) {
-    i_samples[i] = (iq_buffer[2 * i] - 127.5f) / 127.5f;
-    q_samples[i] = (iq_buffer[2 * i + 1] - 127.5f) / 127.5f;
-  }
-
-  lowPassFilter(i_samples);
-  lowPassFilter(q_samples);
 
-  // Apply squelch: mute signals below the threshold
-  float threshold = squelch_threshold / 100.0;
-  for (size_t i = 0; i < num_samples; i++) {
-    float signal_magnitude = sqrt(i_samples[i] * i_samples[i] + q_samples[i] * q_samples[i]);
-    if (signal_magnitude < threshold) {
-      i_samples[i] = 0.0f;
-      q_samples[i] = 0.0f;
-    }
-  }
+  // Squelch compares squared magnitudes with the squared threshold
+  float threshold = squelch_threshold / 100.0f;
+  float threshold2 = threshold * threshold;
 
   // AGC Variables
-  static float gain = 1.0f; // Initial gain
   const float target_level = 0.5f; // Desired average amplitude
   const float agc_rate = 0.01f; // Adjusts how fast AGC reacts
 
-  for (size_t j = 0; j < num_samples; j += DECIMATION) {
-    float i = i_samples[j] * gain;
-    float q = q_samples[j] * gain;
-    am_signal[j / DECIMATION] = sqrt(i * i + q * q); // Envelope detection
+  fe.pcm.clear();
+  fe.pcm.reserve(num_samples / DECIMATION + 1);
+  for (size_t start = 0, n; start < num_samples; start += n) {
+    n = min(num_samples - start, FrontEnd::BLOCK);
 
-    // AGC: Adjust gain based on signal level
-    float signal_level = am_signal[j / DECIMATION];
-    gain *= (1.0f + agc_rate * (target_level - signal_level)); // Adaptive gain control
-  }
+    // Convert IQ samples to floating point values straight into the filters
+    dspKernels()->deinterleave(iq_buffer + 2 * start, fe.i_filter.input(), fe.q_filter.input(), n, 1.0f / 127.5f);
+
+    size_t count = fe.i_filter.decimate(n, fe.i_samples.data());
+    fe.q_filter.decimate(n, fe.q_samples.data());
+
+    for (size_t j = 0; j < count; j++) {
+      float i = fe.i_samples[j];
+      float q = fe.q_samples[j];
+
+      // Apply squelch: mute signals below the threshold
+      if (i * i + q * q < threshold2) {
+        i = q = 0.0f;
+      }
+
+      i *= fe.gain;
+      q *= fe.gain;
+      float signal_level = sqrt(i * i + q * q); // Envelope detection
+      fe.gain *= (1.0f + agc_rate * (target_level - signal_level)); // Adaptive gain control
 
-  // Convert to PCM format
-  vector<int16_t> pcm(am_signal.size());
-  for (size_t i = 0; i < am_signal.size(); i++) {
-    int16_t sample = static_cast<int16_t>(am_signal[i] * 32767);
-    pcm[i] = sample;
+      // Convert to PCM format
+      fe.pcm.push_back(static_cast<int16_t>(signal_level * 32767));
+    }
   }
-  detector.process_buffer(pcm);	// instead, you can send it to audio...
+  detector.process_buffer(fe.pcm);	// instead, you can send it to audio...
 }
 
 // RTL-SDR Async Callback Function
@@ -350,12 +349,9 @@ int main(int argc, char **argv) {
   }
   rtlsdr_reset_buffer(dev);
 
-  createLowPassFilter(3000.0f, SAMPLE_RATE);
-
   cout << "Starting RTL-SDR async stream... at " << float(freq/1000000.0) << "Mhz" << endl;
   rtlsdr_read_async(dev, rtlCallback, nullptr, 0, BUFFER_SIZE);
 
-  firfilt_rrrf_destroy(filter);
   rtlsdr_close(dev);
   return 0;
 }
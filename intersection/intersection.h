@@ -0,0 +1,34 @@
+#pragma once
+#include <optional>
+#include <span>
+
+using namespace std;
+
+// Degrees of error in a fresh bearing of full quality
+const double BEARING_SIGMA = 1.0;
+
+// One bearing from a VOR: station position and radial in degrees, when it
+// was measured in seconds on the caller's clock, and a 0..1 quality that
+// scales its weight
+struct Station {
+  double lat, lon, bearing, timestamp;
+  double quality = 1.0;
+};
+
+struct LatLon {
+  double lat, lon;
+};
+
+// Position with its 1-sigma error ellipse: semi-axes in meters and the
+// azimuth of the major axis in degrees
+struct Fix {
+  double lat, lon;
+  double semiMajor, semiMinor, orientation;
+};
+
+// Fills the ellipse of fix from an east/north position covariance in m^2
+void errorEllipse(double cee, double cen, double cnn, Fix& fix);
+
+// Least-squares position from two or more bearings, or nullopt when they
+// do not constrain one
+optional<Fix> calc_position(span<const Station> stations);
@@ -0,0 +1,356 @@
+#include "intersection.h"
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <GeographicLib/Geodesic.hpp>
+#include <GeographicLib/GeodesicLine.hpp>
+
+
+using namespace GeographicLib;
+using namespace std;
+
+const double DEG2RAD = M_PI / 180.0;
+const double RAD2DEG = 180.0 / M_PI;
+const double EARTH_RADIUS = 6371000.0; // meters
+
+const double MAX_RANGE = 400000.0;  // meters (VOR range)
+const double BEARING_DRIFT = 0.1;   // degrees per second of age, as the receiver moves on
+const double MAX_RESIDUAL = 5.0;    // degrees, larger misfits are treated as outliers
+const int MAX_SEED_ITERATIONS = 200;
+const double MAX_STEP = 100000.0;   // meters, damps Gauss-Newton far from the solution
+const int MAX_GN_ITERATIONS = 20;
+const double MIN_CROSSING_ANGLE = 1.0; // degrees, shallower pairs are too ill-conditioned
+const int MAX_NEWTON_ITERATIONS = 10;
+
+// Convert lat/lon to 3D Cartesian
+void latLonToXYZ(const LatLon& ll, double& x, double& y, double& z) {
+  double latRad = ll.lat * DEG2RAD;
+  double lonRad = ll.lon * DEG2RAD;
+  x = cos(latRad) * cos(lonRad);
+  y = cos(latRad) * sin(lonRad);
+  z = sin(latRad);
+}
+
+// Convert 3D Cartesian to lat/lon
+LatLon xyzToPosition(double x, double y, double z) {
+  double hyp = sqrt(x * x + y * y);
+  double lat = atan2(z, hyp) * RAD2DEG;
+  double lon = atan2(y, x) * RAD2DEG;
+  return {lat, lon};
+}
+
+// Normalize angle to [-180, 180)
+double normalizeAngle(double angle) {
+  return fmod(angle + 540.0, 360.0) - 180.0;
+}
+
+void errorEllipse(double cee, double cen, double cnn, Fix& fix) {
+  double mean = (cee + cnn) / 2;
+  double spread = hypot((cee - cnn) / 2, cen);
+  double orientation = 90.0 - 0.5 * atan2(2 * cen, cee - cnn) * RAD2DEG;
+  fix.semiMajor = sqrt(mean + spread);
+  fix.semiMinor = sqrt(max(0.0, mean - spread));
+  fix.orientation = fmod(orientation + 180.0, 180.0);
+}
+
+// Unit tangent at ll pointing along azimuth az, and the normal of the great
+// circle it starts
+void bearingToXYZ(const LatLon& ll, double az, double d[3], double n[3]) {
+  double lat = ll.lat * DEG2RAD, lon = ll.lon * DEG2RAD, a = az * DEG2RAD;
+  double p[3];
+  latLonToXYZ(ll, p[0], p[1], p[2]);
+  double north[3] = {-sin(lat) * cos(lon), -sin(lat) * sin(lon), cos(lat)};
+  double east[3] = {-sin(lon), cos(lon), 0};
+  for (int i = 0; i < 3; ++i) {
+    d[i] = cos(a) * north[i] + sin(a) * east[i];
+  }
+  n[0] = p[1] * d[2] - p[2] * d[1];
+  n[1] = p[2] * d[0] - p[0] * d[2];
+  n[2] = p[0] * d[1] - p[1] * d[0];
+}
+
+// Point on the sphere closest to every bearing's great circle: the eigenvector
+// of sum(w n n^T) with the smallest eigenvalue, found by power iteration on
+// trace*I - M. Of its two antipodes, the one ahead of the bearings is kept.
+LatLon sphericalSeed(span<const Station> stations, const vector<double>& weights) {
+  double m[3][3] = {};
+  double start[3] = {};
+  for (size_t i = 0; i < stations.size(); ++i) {
+    double d[3], n[3], p[3];
+    bearingToXYZ({stations[i].lat, stations[i].lon}, stations[i].bearing, d, n);
+    latLonToXYZ({stations[i].lat, stations[i].lon}, p[0], p[1], p[2]);
+    for (int r = 0; r < 3; ++r) {
+      for (int c = 0; c < 3; ++c) {
+        m[r][c] += weights[i] * n[r] * n[c];
+      }
+      start[r] += p[r];
+    }
+  }
+
+  double trace = m[0][0] + m[1][1] + m[2][2];
+  double x[3] = {start[0], start[1], start[2]};
+  for (int iter = 0; iter < MAX_SEED_ITERATIONS; ++iter) {
+    double next[3];
+    for (int r = 0; r < 3; ++r) {
+      next[r] = trace * x[r] - (m[r][0] * x[0] + m[r][1] * x[1] + m[r][2] * x[2]);
+    }
+    double norm = sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+    double change = 0;
+    for (int r = 0; r < 3; ++r) {
+      next[r] /= norm;
+      change += abs(next[r] - x[r]);
+      x[r] = next[r];
+    }
+    if (change < 1e-12) {
+      break;
+    }
+  }
+
+  double ahead = 0;
+  for (size_t i = 0; i < stations.size(); ++i) {
+    double d[3], n[3];
+    bearingToXYZ({stations[i].lat, stations[i].lon}, stations[i].bearing, d, n);
+    ahead += weights[i] * (x[0] * d[0] + x[1] * d[1] + x[2] * d[2]);
+  }
+  if (ahead < 0) {
+    return xyzToPosition(-x[0], -x[1], -x[2]);
+  }
+  return xyzToPosition(x[0], x[1], x[2]);
+}
+
+// Distance along the bearing line from ll to the sphere point x, negative
+// when x lies behind the station
+double distanceAlong(const LatLon& ll, const double d[3], const double x[3]) {
+  double p[3];
+  latLonToXYZ(ll, p[0], p[1], p[2]);
+  double along = x[0] * d[0] + x[1] * d[1] + x[2] * d[2];
+  double toward = x[0] * p[0] + x[1] * p[1] + x[2] * p[2];
+  return atan2(along, toward) * EARTH_RADIUS;
+}
+
+// Crossing of two great circles on a sphere, as the distance along line 1.
+// Rejects pairs that are near-parallel or whose crossing is behind either station.
+optional<double> pairSeed(const LatLon& ll1, double az1, const LatLon& ll2, double az2) {
+  double d1[3], n1[3], d2[3], n2[3];
+  bearingToXYZ(ll1, az1, d1, n1);
+  bearingToXYZ(ll2, az2, d2, n2);
+
+  double x[3] = {
+    n1[1] * n2[2] - n1[2] * n2[1],
+    n1[2] * n2[0] - n1[0] * n2[2],
+    n1[0] * n2[1] - n1[1] * n2[0]};
+  double norm = sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+  if (norm < sin(MIN_CROSSING_ANGLE * DEG2RAD)) {
+    return nullopt;
+  }
+  for (auto& c : x) {
+    c /= norm;
+  }
+
+  // The circles cross twice; take the crossing ahead of station 1
+  double s1 = distanceAlong(ll1, d1, x);
+  if (s1 < 0) {
+    for (auto& c : x) {
+      c = -c;
+    }
+    s1 = distanceAlong(ll1, d1, x);
+  }
+  // The sphere is within 1% of the ellipsoid; the exact range check is after refinement
+  double s2 = distanceAlong(ll2, d2, x);
+  if (s2 <= 0 || s1 > MAX_RANGE * 1.01 || s2 > MAX_RANGE * 1.01) {
+    return nullopt;
+  }
+  return s1;
+}
+
+// Intersect the geodesic from station 1 along az1 with the one from station 2
+// along az2. Seeds from the spherical solution, then runs Newton on the
+// distance s along line 1 until station 2 sees the point at az2. The slope
+// d(az)/ds is sin(crossing angle) / m12, from the reduced length of the
+// geodesic from station 2.
+bool findIntersection(
+    const Geodesic& geod,
+    double lat1, double lon1, double az1,
+    double lat2, double lon2, double az2,
+    double& latInt, double& lonInt)
+{
+  auto seed = pairSeed({lat1, lon1}, az1, {lat2, lon2}, az2);
+  if (!seed) {
+    return false;
+  }
+
+  GeodesicLine line1 = geod.Line(lat1, lon1, az1);
+  double s = *seed;
+  for (int iter = 0; iter < MAX_NEWTON_ITERATIONS; ++iter) {
+    double plat, plon, azLine;
+    line1.Position(s, plat, plon, azLine);  // point on line 1
+
+    double s2, az2ToPoint, azAtPoint, m12;
+    geod.Inverse(lat2, lon2, plat, plon, s2, az2ToPoint, azAtPoint, m12);  // FROM line2 point TO current point
+
+    double azErr = normalizeAngle(az2ToPoint - az2) * DEG2RAD;
+    if (abs(azErr) * s2 < 0.01) {  // within a centimetre of line 2
+      if (s <= 0 || s > MAX_RANGE || s2 > MAX_RANGE) {
+        return false;
+      }
+      latInt = plat;
+      lonInt = plon;
+      return true;
+    }
+
+    double slope = sin((azLine - azAtPoint) * DEG2RAD) / m12;
+    if (abs(slope) * MAX_RANGE < 1e-3) {
+      return false;
+    }
+    s -= azErr / slope;
+  }
+
+  return false;
+}
+
+// Crossing of the most heavily weighted pair of bearings that does cross
+// ahead of both stations and within range
+optional<LatLon> crossingSeed(span<const Station> stations, const vector<double>& weights) {
+  vector<pair<size_t, size_t>> pairs;
+  for (size_t i = 0; i < stations.size(); ++i) {
+    for (size_t j = i + 1; j < stations.size(); ++j) {
+      pairs.emplace_back(i, j);
+    }
+  }
+  sort(pairs.begin(), pairs.end(), [&](const auto& x, const auto& y) {
+      return weights[x.first] * weights[x.second] > weights[y.first] * weights[y.second];
+      });
+
+  const Geodesic& geod = Geodesic::WGS84();
+  for (auto [i, j] : pairs) {
+    LatLon crossing;
+    if (findIntersection(geod, stations[i].lat, stations[i].lon, stations[i].bearing,
+          stations[j].lat, stations[j].lon, stations[j].bearing, crossing.lat, crossing.lon)) {
+      return crossing;
+    }
+  }
+  return nullopt;
+}
+
+// Weighted Gauss-Newton on the ellipsoid over the local east/north plane.
+// Moving the point across the geodesic from a station turns the azimuth seen
+// from it by the displacement over the reduced length m12, which gives each
+// bearing's Jacobian row. Sets worst to the index of the largest misfit at
+// the solution, or at the seed when there is none.
+optional<Fix> fitPosition(span<const Station> stations, const vector<double>& weights,
+    LatLon p, size_t& worst, double& worstResidual)
+{
+  const Geodesic& geod = Geodesic::WGS84();
+
+  for (int iter = 0; iter < MAX_GN_ITERATIONS; ++iter) {
+    double a = 0, b = 0, c = 0;  // J^T W J = [a b; b c]
+    double ge = 0, gn = 0;       // J^T W r
+    double chi2 = 0;
+    double farthest = 0;
+    size_t iterWorst = 0;
+    double iterWorstResidual = 0;
+
+    for (size_t i = 0; i < stations.size(); ++i) {
+      double s12, azi1, azi2, m12;
+      geod.Inverse(stations[i].lat, stations[i].lon, p.lat, p.lon, s12, azi1, azi2, m12);
+      farthest = max(farthest, s12);
+      if (m12 < 1.0) {  // sitting on the station, the azimuth is undefined
+        continue;
+      }
+
+      double r = normalizeAngle(azi1 - stations[i].bearing);
+      if (abs(r) > iterWorstResidual) {
+        iterWorstResidual = abs(r);
+        iterWorst = i;
+      }
+      r *= DEG2RAD;
+      double je = cos(azi2 * DEG2RAD) / m12;
+      double jn = -sin(azi2 * DEG2RAD) / m12;
+      double w = weights[i];
+      a += w * je * je;
+      b += w * je * jn;
+      c += w * jn * jn;
+      ge += w * je * r;
+      gn += w * jn * r;
+      chi2 += w * r * r;
+    }
+
+    if (iter == 0) {
+      worst = iterWorst;
+      worstResidual = iterWorstResidual;
+    }
+
+    double det = a * c - b * b;
+    if (!(det > 0)) {  // bearings all along one line
+      return nullopt;
+    }
+    double de = -(c * ge - b * gn) / det;
+    double dn = -(a * gn - b * ge) / det;
+    double step = hypot(de, dn);
+    geod.Direct(p.lat, p.lon, atan2(de, dn) * RAD2DEG, min(step, MAX_STEP), p.lat, p.lon);
+
+    if (step < 0.01) {
+      worst = iterWorst;
+      worstResidual = iterWorstResidual;
+      if (farthest > MAX_RANGE) {  // no VOR is heard that far out
+        return nullopt;
+      }
+
+      // Covariance (J^T W J)^-1, scaled up when the bearings disagree more
+      // than their sigmas allow
+      double dof = stations.size() > 2 ? stations.size() - 2.0 : 1.0;
+      double scale = max(1.0, chi2 / dof);
+      Fix fix{p.lat, p.lon, 0, 0, 0};
+      errorEllipse(c / det * scale, -b / det * scale, a / det * scale, fix);
+      if (fix.semiMajor > MAX_RANGE) {  // too ill-conditioned to be of use
+        return nullopt;
+      }
+      return fix;
+    }
+  }
+
+  return nullopt;
+}
+
+optional<Fix> calc_position(span<const Station> stations) {
+  vector<Station> used;
+  double newest = 0;
+  for (const auto& station : stations) {
+    if (station.quality > 0) {
+      used.push_back(station);
+      newest = used.size() == 1 ? station.timestamp : max(newest, station.timestamp);
+    }
+  }
+
+  // Each bearing is weighted 1/sigma^2; sigma grows as quality drops and as
+  // the reading ages relative to the newest one
+  vector<double> weights;
+  for (const auto& station : used) {
+    double sigma = BEARING_SIGMA / min(station.quality, 1.0);
+    double drift = BEARING_DRIFT * (newest - station.timestamp);
+    weights.push_back(1.0 / ((sigma * sigma + drift * drift) * DEG2RAD * DEG2RAD));
+  }
+
+  while (used.size() >= 2) { // If we received just one VOR, position cannot be calculated
+    size_t worst = 0;
+    double worstResidual = 0;
+    auto fix = fitPosition(used, weights, sphericalSeed(used, weights), worst, worstResidual);
+    if (!fix) {
+      // The joint seed can sit between widely spread bearings and diverge;
+      // restart from where the strongest crossing pair actually meets
+      if (auto seed = crossingSeed(used, weights)) {
+        fix = fitPosition(used, weights, *seed, worst, worstResidual);
+      }
+    }
+    if (fix && worstResidual <= MAX_RESIDUAL) {
+      return fix;
+    }
+    if (used.size() == 2) { // nothing left to drop
+      return nullopt;
+    }
+    used.erase(used.begin() + worst);
+    weights.erase(weights.begin() + worst);
+  }
+
+  return nullopt;
+}
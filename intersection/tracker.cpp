@@ -0,0 +1,137 @@
+#include "tracker.h"
+#include <cmath>
+#include <algorithm>
+#include <GeographicLib/Geodesic.hpp>
+
+using namespace GeographicLib;
+using namespace std;
+
+const double DEG2RAD = M_PI / 180.0;
+const double RAD2DEG = 180.0 / M_PI;
+
+const double ACCELERATION_NOISE = 2.0; // m/s^2, how hard the receiver may turn or speed up
+const double MAX_SPEED = 150.0;        // m/s, velocity uncertainty of a new track
+const double GATE = 5.0;               // innovation sigmas beyond which a bearing is rejected
+const int MAX_REJECTS = 3;
+
+void Tracker::reset(const Fix& fix, double timestamp) {
+  tracking = true;
+  rejects = 0;
+  time = timestamp;
+  lat = fix.lat;
+  lon = fix.lon;
+  velocityEast = velocityNorth = 0;
+
+  // Covariance from the ellipse: a^2 along the major axis, b^2 across it
+  double az = fix.orientation * DEG2RAD;
+  double ue = sin(az), un = cos(az);
+  double a2 = fix.semiMajor * fix.semiMajor, b2 = fix.semiMinor * fix.semiMinor;
+  for (auto& row : p) {
+    fill(begin(row), end(row), 0.0);
+  }
+  p[0][0] = a2 * ue * ue + b2 * un * un;
+  p[1][1] = a2 * un * un + b2 * ue * ue;
+  p[0][1] = p[1][0] = (a2 - b2) * ue * un;
+  p[2][2] = p[3][3] = MAX_SPEED * MAX_SPEED;
+}
+
+// Moves the state along its velocity to timestamp and grows the covariance
+// by the white-acceleration process noise. Late bearings from a slower
+// receiver are applied at the current time.
+void Tracker::predict(double timestamp) {
+  double dt = timestamp - time;
+  if (dt <= 0) {
+    return;
+  }
+  time = timestamp;
+
+  // The velocity keeps its azimuth relative to the geodesic it follows
+  double speed = hypot(velocityEast, velocityNorth);
+  if (speed > 0) {
+    double azi2;
+    Geodesic::WGS84().Direct(lat, lon, atan2(velocityEast, velocityNorth) * RAD2DEG, speed * dt, lat, lon, azi2);
+    velocityEast = speed * sin(azi2 * DEG2RAD);
+    velocityNorth = speed * cos(azi2 * DEG2RAD);
+  }
+
+  // P = F P F^T + Q with F = [I dt*I; 0 I]
+  for (int j = 0; j < 4; ++j) {
+    p[0][j] += dt * p[2][j];
+    p[1][j] += dt * p[3][j];
+  }
+  for (int i = 0; i < 4; ++i) {
+    p[i][0] += dt * p[i][2];
+    p[i][1] += dt * p[i][3];
+  }
+
+  double q = ACCELERATION_NOISE * ACCELERATION_NOISE;
+  for (int i = 0; i < 2; ++i) {
+    p[i][i] += q * dt * dt * dt / 3;
+    p[i][i + 2] += q * dt * dt / 2;
+    p[i + 2][i] += q * dt * dt / 2;
+    p[i + 2][i + 2] += q * dt;
+  }
+}
+
+// Scalar EKF update. The measurement is the azimuth from the station, whose
+// slope across the geodesic is 1/m12 as in the least-squares fit.
+bool Tracker::update(const Station& station) {
+  if (!tracking || station.quality <= 0) {
+    return false;
+  }
+  predict(station.timestamp);
+
+  double s12, azi1, azi2, m12;
+  Geodesic::WGS84().Inverse(station.lat, station.lon, lat, lon, s12, azi1, azi2, m12);
+  if (m12 < 1.0) {  // sitting on the station, the azimuth is undefined
+    return false;
+  }
+
+  double h[2] = {cos(azi2 * DEG2RAD) / m12, -sin(azi2 * DEG2RAD) / m12};
+  double r = remainder(station.bearing - azi1, 360.0) * DEG2RAD;
+  double sigma = BEARING_SIGMA / min(station.quality, 1.0) * DEG2RAD;
+
+  double ph[4];
+  for (int i = 0; i < 4; ++i) {
+    ph[i] = p[i][0] * h[0] + p[i][1] * h[1];
+  }
+  double s = h[0] * ph[0] + h[1] * ph[1] + sigma * sigma;
+  if (r * r > GATE * GATE * s) {
+    if (++rejects >= MAX_REJECTS) {
+      tracking = false;
+    }
+    return false;
+  }
+  rejects = 0;
+
+  double k[4];
+  for (int i = 0; i < 4; ++i) {
+    k[i] = ph[i] / s;
+  }
+  double de = k[0] * r, dn = k[1] * r;
+  Geodesic::WGS84().Direct(lat, lon, atan2(de, dn) * RAD2DEG, hypot(de, dn), lat, lon);
+  velocityEast += k[2] * r;
+  velocityNorth += k[3] * r;
+
+  // P -= K S K^T, which is K (P H^T)^T
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      p[i][j] -= k[i] * ph[j];
+    }
+  }
+  return true;
+}
+
+Track Tracker::state(double timestamp) const {
+  Tracker ahead = *this;
+  ahead.predict(timestamp);
+
+  Track track{{ahead.lat, ahead.lon, 0, 0, 0}, ahead.velocityEast, ahead.velocityNorth, {}};
+  errorEllipse(ahead.p[0][0], ahead.p[0][1], ahead.p[1][1], track.fix);
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      track.covariance[i][j] = ahead.p[i][j];
+    }
+  }
+  return track;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "intersection.h"
+
+using namespace std;
+
+// Position, ground velocity in m/s and their covariance, ordered
+// east, north, velocity east, velocity north in meters and m/s
+struct Track {
+  Fix fix;
+  double velocityEast, velocityNorth;
+  double covariance[4][4];
+};
+
+// Constant-velocity extended Kalman filter over bearings. It is started
+// from a least-squares fix and then takes one bearing at a time, so the
+// track keeps moving between measurements and a single station is enough
+// to correct it. The state lives on the ellipsoid; the covariance is kept
+// in the local east/north plane of the current position.
+class Tracker {
+  public:
+    // Starts at fix, at rest, with its ellipse as the position uncertainty
+    void reset(const Fix& fix, double timestamp);
+    void clear() { tracking = false; }
+    bool isTracking() const { return tracking; }
+
+    // Folds in one bearing, or rejects it when it is too far off the track.
+    // After MAX_REJECTS rejections in a row the track is dropped.
+    bool update(const Station& station);
+
+    // The track propagated to timestamp, without changing the filter
+    Track state(double timestamp) const;
+
+  private:
+    void predict(double timestamp);
+
+    bool tracking = false;
+    int rejects = 0;
+    double time = 0;
+    double lat = 0, lon = 0;
+    double velocityEast = 0, velocityNorth = 0;
+    double p[4][4] = {};
+};
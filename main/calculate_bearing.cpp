@@ -1,48 +1,127 @@
 #include "entry.h"
+#include "bearing_engine.h"
+#include "vorify.h"
+#include "consensus.h"
 #include <iostream>
-#include <vector>
 #include <optional>
-#include <sstream>
-#include <cstdio>
-#include <thread>
-#include <mutex>
+#include <vector>
+#include <map>
+#include <algorithm>
 #include <chrono>
 
 using namespace std;
 
-optional<double> calculateBearing(string id, double frequency) {
-  string cmd = "../wrap-bearing-calculator/wrap-bearing-calculator ../bearing-calculator/vorify " + to_string(frequency);
+// Half-width of the 95% confidence interval, in degrees, that ends a
+// measurement
+const double BEARING_CONFIDENCE = 0.2;
 
-  FILE* pipe = popen(cmd.c_str(), "r");
-  if (!pipe) {
-    cerr << "Failed to run command\n";
-    return nullopt;
-  }
+// A consensus still wider than this at the deadline is no bearing at all
+const double MAX_CONFIDENCE = 5.0;
+
+// Readings whose mean resultant length is below this point every which way,
+// as from an empty channel, and are given up on without waiting for the
+// deadline. Noise gives about 0.5; a station read to 3 degrees over 0.999.
+const double MIN_RESULTANT = 0.9;
+
+// Longest a measurement waits for the interval to tighten
+constexpr auto MEASURE_DEADLINE = chrono::seconds(10);
+
+// Readings of one station, combined on the circle with outliers trimmed.
+// The quality figures kept besides the bearing and its error are those of
+// the latest reading.
+struct Readings {
+  consensus_t consensus;
+  consensus_result_t result{};
+  bool estimated = false;
+  vor_bearing_t latest{};
 
-  char buffer[128];
-  string result;
-  while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-    result += buffer;
+  Readings() { consensusInit(&consensus); }
+
+  void add(const vor_bearing_t& reading) {
+    if (!reading.confident) {
+      cerr << "Weak bearing " << reading.bearing << ": error " << reading.error << " deg, reference depth "
+        << reading.refDepth << ", deviation " << reading.deviation << " Hz\n";
+    }
+    consensusAdd(&consensus, reading.bearing, reading.error);
+    estimated = consensusEstimate(&consensus, &result);
+    latest = reading;
   }
 
-  int status = pclose(pipe);
+  bool agreed() const { return estimated && result.confidence <= BEARING_CONFIDENCE; }
+  bool scattered() const { return estimated && result.resultant < MIN_RESULTANT; }
+  bool done() const { return agreed() || scattered(); }
 
-  if (WIFEXITED(status)) {
-    if (WEXITSTATUS(status) != 0) {
-      cerr << "Command exited with code " << WEXITSTATUS(status) << '\n';
+  // The consensus, unless it never became usable
+  optional<vor_bearing_t> bearing() const {
+    if (!estimated || scattered() || result.confidence > MAX_CONFIDENCE) {
+      cerr << "No consensus";
+      if (estimated) {
+        cerr << ": " << result.bearing << " +- " << result.confidence << " from " << result.used << " readings";
+      }
+      cerr << '\n';
       return nullopt;
     }
-  } else if (WIFSIGNALED(status)) {
-    cerr << "Command terminated by signal " << WTERMSIG(status) << '\n';
-    return nullopt;
+    if (result.trimmed) {
+      cerr << "Trimmed " << result.trimmed << " of " << result.used + result.trimmed << " readings as outliers\n";
+    }
+    vor_bearing_t agreed = latest;
+    agreed.bearing = result.bearing;
+    agreed.error = result.error;
+    return agreed;
+  }
+};
+
+// The demodulator reports at least once every VOR_INTERVAL seconds; waits
+// no longer than that, nor past the deadline
+static chrono::milliseconds readingTimeout(chrono::steady_clock::time_point deadline) {
+  auto left = chrono::ceil<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+  return max(chrono::milliseconds(0), min(chrono::milliseconds(chrono::seconds(VOR_INTERVAL + 2)), left));
+}
+
+// Reads bearings on the frequency the engine is currently tuned to until
+// they agree closely enough or the deadline passes
+optional<vor_bearing_t> calculateBearing(BearingEngine& engine) {
+  Readings readings;
+  auto deadline = chrono::steady_clock::now() + MEASURE_DEADLINE;
+  while (!readings.done() && chrono::steady_clock::now() < deadline) {
+    optional<vor_bearing_t> value = engine.pullBearing(readingTimeout(deadline));
+    if (!value) {
+      break;
+    }
+    readings.add(*value);
+  }
+
+  return readings.bearing();
+}
+
+// Reads bearings for every station of the window the engine is tuned to
+vector<optional<vor_bearing_t>> calculateBearings(BearingEngine& engine, const vector<double>& frequencies) {
+  map<double, Readings> readings;
+  for (double frequency : frequencies) {
+    readings[frequency];
+  }
+
+  size_t done = 0;
+  auto deadline = chrono::steady_clock::now() + MEASURE_DEADLINE;
+  while (done < readings.size() && chrono::steady_clock::now() < deadline) {
+    auto value = engine.pullChannelBearing(readingTimeout(deadline));
+    if (!value) {
+      break;
+    }
+
+    auto it = readings.find(value->first);
+    if (it == readings.end() || it->second.done()) {
+      continue;
+    }
+    it->second.add(value->second);
+    if (it->second.done()) {
+      done++;
+    }
   }
 
-  istringstream iss(result);
-  double value;
-  if (iss >> value) {
-    return value;
-  } else {
-    cerr << "Failed to parse output as double: " << result << '\n';
-    return nullopt;
+  vector<optional<vor_bearing_t>> bearings;
+  for (double frequency : frequencies) {
+    bearings.push_back(readings[frequency].bearing());
   }
+  return bearings;
 }
@@ -0,0 +1,88 @@
+#include "entry.h"
+#include <cmath>
+#include <functional>
+
+using namespace std;
+
+// Frequencies are keyed in whole kHz so 112.75 and 112.750000001 match
+size_t EntryTable::slot(string_view id, double frequency) const {
+  size_t khz = lround(frequency * 1000.0);
+  return (hash<string_view>()(id) ^ (khz * 0x9E3779B97F4A7C15ull)) & (index.size() - 1);
+}
+
+// Rebuilt from scratch on every change; the set only changes when the
+// position has moved or an ident fails, and holds a few dozen stations
+void EntryTable::reindex() {
+  size_t capacity = 16;
+  while (capacity < 2 * order.size()) {
+    capacity *= 2;
+  }
+  index.assign(capacity, EMPTY);
+  for (EntryHandle h : order) {
+    size_t i = slot(id[h], frequency[h]);
+    while (index[i] != EMPTY) {
+      i = (i + 1) & (capacity - 1);
+    }
+    index[i] = h;
+  }
+}
+
+EntryHandle EntryTable::add(uint32_t rec, const char* stationName, const char* stationId, double freq, Location location) {
+  EntryHandle h;
+  if (!freeHandles.empty()) {
+    h = freeHandles.back();
+    freeHandles.pop_back();
+  } else {
+    h = record.size();
+    record.emplace_back();
+    name.emplace_back();
+    id.emplace_back();
+    frequency.emplace_back();
+    lat.emplace_back();
+    lon.emplace_back();
+    identified.emplace_back();
+    wrongIdent.emplace_back();
+    wrongIdentCount.emplace_back();
+    bearing.emplace_back();
+    distance.emplace_back();
+  }
+
+  record[h] = rec;
+  name[h] = stationName;
+  id[h] = stationId;
+  frequency[h] = freq;
+  lat[h] = location.lat;
+  lon[h] = location.lon;
+  identified[h] = true;
+  wrongIdent[h] = 0;
+  wrongIdentCount[h] = 0;
+  bearing[h] = nullopt;
+  distance[h] = nullopt;
+  order.push_back(h);
+  reindex();
+  return h;
+}
+
+void EntryTable::remove(EntryHandle handle) {
+  auto it = std::find(order.begin(), order.end(), handle);
+  if (it == order.end()) {
+    return;
+  }
+  order.erase(it);
+  freeHandles.push_back(handle);
+  reindex();
+}
+
+optional<EntryHandle> EntryTable::find(string_view stationId, double freq) const {
+  if (index.empty()) {
+    return nullopt;
+  }
+  long khz = lround(freq * 1000.0);
+  for (size_t i = slot(stationId, freq); index[i] != EMPTY; i = (i + 1) & (index.size() - 1)) {
+    EntryHandle h = index[i];
+    if (lround(frequency[h] * 1000.0) == khz && id[h] == stationId) {
+      return h;
+    }
+  }
+  return nullopt;
+}
@@ -1,30 +1,73 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <optional>
 #include <chrono>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
 
 using namespace std;
 
 struct BearingInfo {
   double value;
   chrono::steady_clock::time_point timestamp;
+  double error = 0;   // standard error in degrees from the demodulator
 };
 
 struct Location {
-  string lat;
-  string lon;
+  double lat;
+  double lon;
 
   bool operator==(const Location& other) const {
     return lat == other.lat && lon == other.lon;
   }
 };
 
-struct Entry {
-  string name;
-  string id;
-  double frequency;
-  Location location;
-  bool is_identified = true;
-  optional<BearingInfo> bearing;
-  optional<double> distance;
+// Slot of a station in an EntryTable
+using EntryHandle = uint32_t;
+
+// The stations in range, stored column-wise so the per-bearing and
+// per-refresh loops walk plain arrays of doubles. A handle stays valid until
+// its station is removed; freed slots are reused by later additions. Names
+// and IDs point into the station database, which outlives the table, so an
+// entry owns no heap memory of its own. Stations are found by (id,
+// frequency) through an open-addressing index over the handles.
+class EntryTable {
+  public:
+    EntryHandle add(uint32_t record, const char* name, const char* id, double frequency, Location location);
+    void remove(EntryHandle handle);
+    optional<EntryHandle> find(string_view id, double frequency) const;
+
+    // Live handles in display order
+    const vector<EntryHandle>& handles() const { return order; }
+    size_t size() const { return order.size(); }
+    bool empty() const { return order.empty(); }
+
+    template <typename Compare>
+    void sort(Compare compare) { std::sort(order.begin(), order.end(), compare); }
+
+    vector<uint32_t> record;  // index in the station database
+    vector<const char*> name;
+    vector<const char*> id;
+    vector<double> frequency;
+    vector<double> lat;
+    vector<double> lon;
+    vector<bool> identified;
+    // Hash of the last decoded ident that disagreed with id, and how many
+    // decodes in a row gave it
+    vector<size_t> wrongIdent;
+    vector<int> wrongIdentCount;
+    vector<optional<BearingInfo>> bearing;
+    vector<optional<double>> distance;
+
+  private:
+    static constexpr EntryHandle EMPTY = UINT32_MAX;
+
+    size_t slot(string_view id, double frequency) const;
+    void reindex();
+
+    vector<EntryHandle> order;
+    vector<EntryHandle> freeHandles;
+    vector<EntryHandle> index;  // power-of-two sized, at most half full
 };
@@ -1,55 +1,186 @@
-#include <iostream>
-#include <iomanip>
-#include <sstream>
+#include "nmea.h"
 #include <cmath>
 #include <ctime>
+#include <algorithm>
 
 using namespace std;
 
-string generateNMEA(double lat, double lon) {
-  double speedKnots = 0.0;
-  double courseDeg = 0.0;
-  ostringstream sentence;
-
-  // Time and date
-  time_t now = time(nullptr);
-  tm *utc = gmtime(&now);
-
-  // Latitude
-  char latHemi = (lat >= 0) ? 'N' : 'S';
-  lat = fabs(lat);
-  int latDeg = static_cast<int>(lat);
-  double latMin = (lat - latDeg) * 60.0;
-
-  // Longitude
-  char lonHemi = (lon >= 0) ? 'E' : 'W';
-  lon = fabs(lon);
-  int lonDeg = static_cast<int>(lon);
-  double lonMin = (lon - lonDeg) * 60.0;
-
-  // Build body of the sentence
-  ostringstream body;
-  body << "GPGGA,"
-    << setfill('0') << setw(2) << utc->tm_hour
-    << setw(2) << utc->tm_min
-    << setw(2) << utc->tm_sec << ".00,"
-    << setw(2) << latDeg << fixed << setprecision(6)
-    << setw(7) << latMin << "," << latHemi << ","
-    << setw(3) << lonDeg << fixed << setprecision(6)
-    << setw(7) << lonMin << "," << lonHemi << ","
-    << "1,10,1.0,33.6,M,19.0,M,,";
-
-  string bodyStr = body.str();
-
-  // Calculate checksum
+const double EARTH_RADIUS = 6371000.0;    // meters, for carrying the position forward
+const double METERS_PER_HDOP = 5.0;       // horizontal error one unit of HDOP stands for
+const double MIN_COURSE_SPEED = 0.5;      // m/s, below which the course is left empty
+const double KNOTS_PER_MPS = 1.943844;
+const double KMH_PER_MPS = 3.6;
+
+// How far past the last tracker update the position is carried forward
+constexpr auto MAX_EXTRAPOLATION = chrono::seconds(5);
+
+void NmeaEngine::putInt(long long value, int width) {
+  if (value < 0) {
+    put('-');
+    value = -value;
+  }
+  char digits[20];
+  int count = 0;
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  for (int i = count; i < width; ++i) {
+    put('0');
+  }
+  while (count > 0) {
+    put(digits[--count]);
+  }
+}
+
+void NmeaEngine::putFixed(double value, int decimals) {
+  long long scale = 1;
+  for (int i = 0; i < decimals; ++i) {
+    scale *= 10;
+  }
+  long long scaled = llround(value * scale);
+  if (scaled < 0) {
+    put('-');
+    scaled = -scaled;
+  }
+  putInt(scaled / scale, 1);
+  put('.');
+  putInt(scaled % scale, decimals);
+}
+
+// ddmm.mmmmmm or dddmm.mmmmmm and the hemisphere. Rounding is done on whole
+// micro-minutes so the minutes never print as 60.
+void NmeaEngine::putLatLon(double degrees, int degreeWidth, char positive, char negative) {
+  long long microMinutes = llround(fabs(degrees) * 60e6);
+  putInt(microMinutes / 60000000, degreeWidth);
+  long long minutes = microMinutes % 60000000;
+  putInt(minutes / 1000000, 2);
+  put('.');
+  putInt(minutes % 1000000, 6);
+  put(',');
+  put(degrees >= 0 ? positive : negative);
+}
+
+void NmeaEngine::begin(const char* type) {
+  start = length;
+  put('$');
+  put(type);
+  put(',');
+}
+
+void NmeaEngine::end() {
   unsigned char checksum = 0;
-  for (char ch : bodyStr) {
-    checksum ^= ch;
+  for (size_t i = start + 1; i < length; ++i) {
+    checksum ^= buffer[i];
   }
+  const char* hex = "0123456789ABCDEF";
+  put('*');
+  put(hex[checksum >> 4]);
+  put(hex[checksum & 0xF]);
+  put('\r');
+  put('\n');
+}
+
+string_view NmeaEngine::sentences() {
+  length = 0;
+
+  auto wall = chrono::system_clock::now();
+  time_t seconds = chrono::system_clock::to_time_t(wall);
+  tm utc;
+  gmtime_r(&seconds, &utc);
+  long long centiseconds = chrono::duration_cast<chrono::milliseconds>(wall.time_since_epoch()).count() % 1000 / 10;
+
+  optional<NavState> now = nav;
+  if (now) {
+    auto age = chrono::steady_clock::now() - now->time;
+    if (age > MAX_EXTRAPOLATION) {
+      now = nullopt;
+    } else {
+      double dt = chrono::duration<double>(age).count();
+      now->lat += now->velocityNorth * dt / EARTH_RADIUS * 180.0 / M_PI;
+      now->lon += now->velocityEast * dt / (EARTH_RADIUS * cos(now->lat * M_PI / 180.0)) * 180.0 / M_PI;
+      now->lon = remainder(now->lon, 360.0);
+    }
+  }
+
+  double speed = now ? hypot(now->velocityEast, now->velocityNorth) : 0;
+  double course = now ? fmod(atan2(now->velocityEast, now->velocityNorth) * 180.0 / M_PI + 360.0, 360.0) : 0;
+  bool hasCourse = now && speed >= MIN_COURSE_SPEED;
+  double hdop = now ? clamp(now->error / METERS_PER_HDOP, 0.5, 99.9) : 0;
 
-  // Assemble final sentence
-  sentence << "$" << bodyStr << "*" << uppercase << hex
-    << setw(2) << setfill('0') << static_cast<int>(checksum) << "\n";
+  auto putTime = [&]() {
+    putInt(utc.tm_hour, 2);
+    putInt(utc.tm_min, 2);
+    putInt(utc.tm_sec, 2);
+    put('.');
+    putInt(centiseconds, 2);
+    put(',');
+  };
+
+  begin("GPGGA");
+  putTime();
+  if (now) {
+    putLatLon(now->lat, 2, 'N', 'S');
+    put(',');
+    putLatLon(now->lon, 3, 'E', 'W');
+    put(",1,10,");
+    putFixed(hdop, 1);
+    put(",33.6,M,19.0,M,,");
+  } else {
+    put(",,,,0,,,,,,,,");
+  }
+  end();
+
+  begin("GPRMC");
+  putTime();
+  if (now) {
+    put("A,");
+    putLatLon(now->lat, 2, 'N', 'S');
+    put(',');
+    putLatLon(now->lon, 3, 'E', 'W');
+    put(',');
+    putFixed(speed * KNOTS_PER_MPS, 1);
+    put(',');
+    if (hasCourse) {
+      putFixed(course, 1);
+    }
+    put(',');
+  } else {
+    put("V,,,,,,,");
+  }
+  putInt(utc.tm_mday, 2);
+  putInt(utc.tm_mon + 1, 2);
+  putInt(utc.tm_year % 100, 2);
+  put(now ? ",,,A" : ",,,N");
+  end();
+
+  begin("GPVTG");
+  if (hasCourse) {
+    putFixed(course, 1);
+  }
+  put(",T,,M,");
+  if (now) {
+    putFixed(speed * KNOTS_PER_MPS, 1);
+    put(",N,");
+    putFixed(speed * KMH_PER_MPS, 1);
+    put(",K,A");
+  } else {
+    put(",N,,K,N");
+  }
+  end();
+
+  // No satellites are used, so the PRN fields stay empty
+  begin("GPGSA");
+  if (now) {
+    put("A,3,,,,,,,,,,,,,");
+    putFixed(hdop, 1);
+    put(',');
+    putFixed(hdop, 1);
+    put(",1.0");
+  } else {
+    put("A,1,,,,,,,,,,,,,,,");
+  }
+  end();
 
-  return sentence.str();
+  return string_view(buffer, length);
 }
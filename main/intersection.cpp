@@ -1,53 +1,39 @@
 #include "entry.h"
+#include "intersection.h"
 #include <iostream>
 #include <vector>
 #include <optional>
-#include <sstream>
-#include <cstdio>
-#include <thread>
-#include <mutex>
 #include <chrono>
-#include <memory>
+#include <cmath>
 
 using namespace std;
 
-string buildIntersectionCommand(const vector<shared_ptr<Entry>>& entries) {
-  string cmd = "../intersection/intersection ";
-  for (const auto& entry : entries) {
-    if (entry->is_identified && entry->bearing.has_value() && chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now()  - entry->bearing->timestamp).count() <= 15) {
-      cmd += entry->location.lat + "," + entry->location.lon + "," + to_string(entry->bearing->value) + " ";
-    }
-  }
-  cout << cmd << endl;
-  return cmd;
+double toSeconds(chrono::steady_clock::time_point time) {
+  return chrono::duration<double>(time.time_since_epoch()).count();
 }
 
-optional<Location> intersection(const vector<shared_ptr<Entry>>& entries) {
-  string cmd = buildIntersectionCommand(entries);
-  FILE* pipe = popen(cmd.c_str(), "r");
-  if (!pipe) {
-    cerr << "Failed to run command: " << cmd << '\n';
-    return nullopt;
-  }
-
-  char buffer[128];
-  string result;
-  while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-    result += buffer;
-  }
+// The latest bearing of an entry as solver input. The demodulator's own
+// error adds to BEARING_SIGMA, which covers the site and propagation errors
+// it cannot see.
+Station observation(const EntryTable& entries, EntryHandle h) {
+  const BearingInfo& bearing = *entries.bearing[h];
+  double quality = BEARING_SIGMA / hypot(BEARING_SIGMA, bearing.error);
+  return Station{entries.lat[h], entries.lon[h], bearing.value, toSeconds(bearing.timestamp), quality};
+}
 
-  int status = pclose(pipe);
-  if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-    cerr << "Command exited with code " << WEXITSTATUS(status) << '\n';
-    return nullopt;
+// Fixes the position from the identified stations with a bearing at most 15s old
+optional<Fix> intersection(const EntryTable& entries) {
+  vector<Station> stations;
+  for (EntryHandle h : entries.handles()) {
+    if (entries.identified[h] && entries.bearing[h].has_value() && chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now()  - entries.bearing[h]->timestamp).count() <= 15) {
+      stations.push_back(observation(entries, h));
+    }
   }
 
-  istringstream iss(result);
-  double lat, lon;
-  if (iss >> lat >> lon) {
-    return Location{to_string(lat), to_string(lon)};
-  } else {
-    cerr << "Failed to parse intersection output: " << result << '\n';
-    return nullopt;
+  auto fix = calc_position(stations);
+  if (fix) {
+    cout << "Fix from " << stations.size() << " bearings, error ellipse " << fix->semiMajor << " x " << fix->semiMinor
+      << " m at " << fix->orientation << "\n";
   }
+  return fix;
 }
@@ -1,17 +1,23 @@
 #include "entry.h"
+#include "stations_to_json.h"
+#include "nmea.h"
+#include "seqlock.h"
+#include "sdr_session.h"
+#include "tracker.h"
 #include <iostream>
 #include <vector>
 #include <optional>
 #include <sstream>
 #include <cstdio>
 #include <thread>
-#include <mutex>
 #include <atomic>
 #include <chrono>
-#include <memory>
+#include <functional>
 #include <GeographicLib/Geodesic.hpp>
 #include <unistd.h>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <cerrno>
 #include <boost/process.hpp>
 #include <boost/asio.hpp>
@@ -19,15 +25,25 @@
 using namespace GeographicLib;
 using namespace std;
 
-string generateNMEA(double lat, double lon);
-vector<shared_ptr<Entry>> getStationsWithinRange(const double lat, const double lon, const int range);
-optional<double> calculateBearing(string id, double frequency);
-optional<Location> intersection(const vector<shared_ptr<Entry>>& entries);
-string entriesToJson(const vector<shared_ptr<Entry>>& entries, const optional<Location>& location);
-void updateStationsWithinRange(vector<shared_ptr<Entry>>& entries1, double lat, double lon, int range);
+bool updateStationsWithinRange(EntryTable& entries, double lat, double lon, int range);
+optional<Fix> intersection(const EntryTable& entries);
+Station observation(const EntryTable& entries, EntryHandle h);
+double toSeconds(chrono::steady_clock::time_point time);
 
+// How often the UI is refreshed when no measurement completes
+constexpr auto UI_REFRESH = chrono::seconds(1);
+
+// The station set is recomputed once the fix moves this far
+constexpr double STATION_REFRESH_KM = 10.0;
+
+// A station is left out of the fix once this many decodes in a row agree on
+// an ident other than its own
+constexpr int IDENT_CONFIRMATIONS = 2;
+
+// The pipe is close-on-exec, so children started later, such as the UI, do
+// not hold it open
 FILE* startBluetoothServer() {
-  FILE* pipe = popen("../bluetooth-server/bluetooth-server", "w");
+  FILE* pipe = popen("../bluetooth-server/bluetooth-server", "we");
   if (!pipe) {
     cerr << "Failed to start bluetooth server\n";
     return nullptr;
@@ -35,35 +51,59 @@ FILE* startBluetoothServer() {
   return pipe;
 }
 
-void sendToBluetooth(FILE* pipe, const string& data) {
+void sendToBluetooth(FILE* pipe, string_view data) {
   if (!pipe) return;
-  fputs(data.c_str(), pipe);
+  fwrite(data.data(), 1, data.size(), pipe);
   fflush(pipe);
   // Pipe stays open for reuse
 }
 
-mutex entriesMutex;
-mutex locationMutex;
-atomic<bool> stationChangeNeeded(false);
+// Sentences per second, from NMEA_RATE_HZ (default MAX_NMEA_RATE_HZ)
+int nmeaRate() {
+  const char* rate = getenv("NMEA_RATE_HZ");
+  if (!rate) {
+    return MAX_NMEA_RATE_HZ;
+  }
+  return clamp(atoi(rate), 1, MAX_NMEA_RATE_HZ);
+}
 
-void startBluetoothServer(optional<Location>& location, bool& running) {
-  thread([&location, &running]() {
-    FILE* bluetoothPipe = startBluetoothServer();
+// Sends at the NMEA rate, and straight away when a new fix is published.
+// The server is started before the thread, so it cannot inherit pipes of
+// children spawned meanwhile. The caller joins the thread once running is
+// cleared, after one more store to wake it.
+thread startBluetoothServer(const Seqlock<optional<NavState>>& position, const atomic<bool>& running) {
+  FILE* bluetoothPipe = startBluetoothServer();
+  return thread([&position, &running, bluetoothPipe]() {
     if (!bluetoothPipe) {
-      return 1;
+      return;
     }
 
+    NmeaEngine nmea;
+    auto period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::seconds(1)) / nmeaRate();
+    auto next = chrono::steady_clock::now() + period;
+    uint32_t version = 0;
     while (running) {
-      this_thread::sleep_for(chrono::seconds(1));
-      lock_guard<mutex> locationLock(locationMutex);
-      if (location) {
-        sendToBluetooth(bluetoothPipe, generateNMEA(stod(location->lat), stod(location->lon)));
-      }
-      else {
-        sendToBluetooth(bluetoothPipe, "$GPGGA,,,,,,0,,,,,,,,*66\n");
+      position.waitUntil(version, next);
+      nmea.update(position.load(&version));
+      sendToBluetooth(bluetoothPipe, nmea.sentences());
+
+      auto now = chrono::steady_clock::now();
+      if (now >= next) {
+        next = max(next + period, now);
       }
     }
-  }).detach();
+  });
+}
+
+// Hand the identified stations to the SDR scheduler
+void scheduleStations(SdrSession& session, const EntryTable& entries) {
+  vector<pair<string, double>> stations;
+  for (EntryHandle h : entries.handles()) {
+    if (entries.identified[h]) {
+      stations.emplace_back(entries.id[h], entries.frequency[h]);
+    }
+  }
+  session.setStations(stations);
 }
 
 double computeDistance(double lat1, double lon1, double lat2, double lon2) {
@@ -73,14 +113,24 @@ double computeDistance(double lat1, double lon1, double lat2, double lon2) {
   return s12 / 1000.0; // convert meters to kilometers
 }
 
+// Everything below runs on the io_context thread, which owns the entries.
+// Bearings, UI origin changes and the refresh timer are posted to it, so
+// whichever comes first is handled immediately. The position is published
+// through a seqlock, which every consumer reads without taking a lock.
+// The location comes from a tracker seeded by a least-squares fix and then
+// corrected by every bearing as it arrives.
 int main() {
-  vector<shared_ptr<Entry>> entries; 
-  optional<Location> location = nullopt;
-  bool running = true;
+  EntryTable entries;
+  Seqlock<optional<NavState>> position;
+  atomic<bool> running{true};
+  SdrSession session;
+  Tracker tracker;
 
-  startBluetoothServer(location, running);
+  thread bluetooth = startBluetoothServer(position, running);
 
   boost::asio::io_context io;
+  auto work = boost::asio::make_work_guard(io);
+  boost::asio::steady_timer refresh(io);
 
   boost::process::opstream child_stdin;
   boost::process::ipstream child_stdout;
@@ -88,105 +138,219 @@ int main() {
   boost::process::child python_process(
       "../venv/bin/python3 ../ui/ui.py",
       boost::process::std_in < child_stdin,
-      boost::process::std_out > child_stdout,
-      io
+      boost::process::std_out > child_stdout
       );
 
-  // Reader thread
-  thread reader([&entries, &location, &child_stdout, &child_stdin]() {
-    string line;
-    while (getline(child_stdout, line)) {
-      double lat, lon;
-      if (sscanf(line.c_str(), "%lf %lf", &lat, &lon) == 2) {
-        stationChangeNeeded.store(true);
-
-        cout << "UPDATING STATIONS" << endl;
+  // Where the station set was last computed
+  optional<Location> lookupCenter;
 
-        lock_guard<mutex> entriesLock(entriesMutex);
+  UiStream uiStream;
+  bool resync = false;
 
-        lock_guard<mutex> locationLock(locationMutex);
-        location = nullopt;
-        cout << "Updated origin_location to: " << lat << ", " << lon << endl;
+  auto currentLocation = [&]() -> optional<Location> {
+    optional<NavState> nav = position.load();
+    if (!nav) {
+      return nullopt;
+    }
+    return Location{nav->lat, nav->lon};
+  };
+
+  auto publish = [&]() {
+    optional<Location> location = currentLocation();
+    string_view message = uiStream.update(entries, location, resync);
+    resync = false;
+    if (!message.empty()) {
+      child_stdin << message << endl;
+    }
+  };
 
-        updateStationsWithinRange(entries, lat, lon, 400);
-        stationChangeNeeded.store(false);
-        string json = entriesToJson(entries, location);
-        child_stdin << json << endl;
+  auto updateDistances = [&]() {
+    optional<Location> location = currentLocation();
+    for (EntryHandle h : entries.handles()) {
+      if (location) {
+        entries.distance[h] = computeDistance(location->lat, location->lon, entries.lat[h], entries.lon[h]);
+      }
+      else {
+        entries.distance[h] = nullopt;
       }
     }
-  });
+  };
 
-  while (running) {
-    this_thread::sleep_for(chrono::milliseconds(300));
-
-    lock_guard<mutex> entriesLock(entriesMutex);
+  auto lookupStations = [&](double lat, double lon, bool force) {
+    if (!force && lookupCenter && computeDistance(lookupCenter->lat, lookupCenter->lon, lat, lon) < STATION_REFRESH_KM) {
+      return;
+    }
+    lookupCenter = Location{lat, lon};
+    if (updateStationsWithinRange(entries, lat, lon, 400)) {
+      scheduleStations(session, entries);
+      updateDistances();
+    }
+  };
 
-    if (entries.size() == 0) {
-      continue;
+  auto setLocation = [&](const optional<Track>& track) {
+    if (!track) {
+      position.store(nullopt);
+      return;
     }
+    NavState nav{track->fix.lat, track->fix.lon, track->velocityEast, track->velocityNorth, track->fix.semiMajor, {},
+      chrono::steady_clock::now()};
+    memcpy(nav.covariance, track->covariance, sizeof(nav.covariance));
+    position.store(nav);
+  };
+
+  auto onOrigin = [&](double lat, double lon) {
+    cout << "UPDATING STATIONS" << endl;
+    setLocation(nullopt);
+    cout << "Updated origin_location to: " << lat << ", " << lon << endl;
+
+    tracker.clear();
+    lookupStations(lat, lon, true);
+    publish();
+  };
+
+  auto fix = [&]() {
+    double now = toSeconds(chrono::steady_clock::now());
+    if (!tracker.isTracking()) {
+      int count = 0;
+      for (EntryHandle h : entries.handles()) {
+        if (entries.identified[h] && entries.bearing[h].has_value() && chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - entries.bearing[h]->timestamp).count() <= 15)
+          ++count;
+      }
 
-    auto now = chrono::steady_clock::now();
+      if (count < 2) {
+        return;
+      }
 
-    auto it = find_if(entries.begin(), entries.end(), [now](const shared_ptr<Entry>& entry) {
-        return entry->is_identified &&
-        (!entry->bearing.has_value() ||
-         chrono::duration_cast<chrono::seconds>(now - entry->bearing->timestamp).count() >= 15);
-        });
+      cout << "intersecting " << count << endl;
+      optional<Fix> found = intersection(entries);
+      if (!found) {
+        setLocation(nullopt);
+        updateDistances();
+        return;
+      }
+      tracker.reset(*found, now);
+    }
+
+    Track track = tracker.state(now);
+    setLocation(track);
+    cout << track.fix.lat << " " << track.fix.lon << " moving " << track.velocityEast << " E " << track.velocityNorth
+      << " N m/s, error ellipse " << track.fix.semiMajor << " x " << track.fix.semiMinor << " m\n";
+    lookupStations(track.fix.lat, track.fix.lon, false);
+    updateDistances();
+  };
+
+  auto onResults = [&]() {
+    bool measured = false;
+    bool stationsChanged = false;
+    for (const auto& result : session.poll()) {
+      optional<EntryHandle> h = entries.find(result.id, result.frequency);
+      if (!h) {
+        continue;
+      }
 
-    if (it != entries.end()) {
-      optional<double> bearing = calculateBearing((*it)->id, (*it)->frequency);
+      if (result.kind == SlotResult::IDENT) {
+        if (result.ident) {
+          cout << "Decoded ID " << *result.ident << " for " << entries.id[*h] << endl;
+          size_t decoded = hash<string>()(*result.ident);
+          if (*result.ident == entries.id[*h]) {
+            entries.wrongIdentCount[*h] = 0;
+          } else if (entries.wrongIdentCount[*h] > 0 && entries.wrongIdent[*h] == decoded) {
+            entries.wrongIdentCount[*h]++;
+          } else {
+            entries.wrongIdent[*h] = decoded;
+            entries.wrongIdentCount[*h] = 1;
+          }
+          if (entries.wrongIdentCount[*h] >= IDENT_CONFIRMATIONS) {
+            cout << "Station " << entries.id[*h] << " keeps sending " << *result.ident << ", leaving it out of the fix" << endl;
+            entries.identified[*h] = false;
+            stationsChanged = true;
+          }
+        }
+        continue;
+      }
 
-      if(bearing) {
-        (*it)->bearing = BearingInfo{*bearing, chrono::steady_clock::now()};
+      if (result.bearing) {
+        entries.bearing[*h] = BearingInfo{*result.bearing, result.timestamp, result.error};
+        measured = true;
+        if (entries.identified[*h] && tracker.isTracking() && !tracker.update(observation(entries, *h))) {
+          cout << "Bearing " << *result.bearing << " from " << entries.id[*h] << " rejected by the tracker" << endl;
+        }
       }
       else {
-        entries.erase(it);
+        entries.remove(*h);
+        stationsChanged = true;
       }
     }
-    else {
-      continue;
-    }
 
-    int count = 0;
-    for (auto& entry : entries) {
-      if (entry->is_identified && entry->bearing.has_value() && chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - entry->bearing->timestamp).count() <= 15)
-        ++count;
+    if (stationsChanged) {
+      scheduleStations(session, entries);
+    }
+    if (measured) {
+      fix();
     }
+    if (measured || stationsChanged) {
+      publish();
+    }
+  };
 
-    if (count >= 2) {
-      cout << "intersecting " << count << endl;
-      lock_guard<mutex> locationLock(locationMutex);
-      location = intersection(entries);
-      if (location) {
-        cout << location->lat << " " << location->lon << "\n";
+  function<void()> scheduleRefresh = [&]() {
+    refresh.expires_after(UI_REFRESH);
+    refresh.async_wait([&](const boost::system::error_code& error) {
+        if (error) {
+          return;
+        }
+        // Keep the position moving along the track between bearings
+        if (tracker.isTracking()) {
+          Track track = tracker.state(toSeconds(chrono::steady_clock::now()));
+          setLocation(track);
+          updateDistances();
+        }
+        if (!entries.empty()) {
+          publish();
+        }
+        scheduleRefresh();
+        });
+  };
 
-        updateStationsWithinRange(entries, stod(location->lat), stod(location->lon), 400);
+  auto shutdown = [&]() {
+    running = false;
+    refresh.cancel();
+    work.reset();
+  };
 
-        for (auto& entry : entries) {
-          entry->distance = computeDistance(
-              stod(location->lat),
-              stod(location->lon),
-              stod(entry->location.lat),
-              stod(entry->location.lon));
-        }
+  session.setResultHandler([&io, &onResults]() {
+      boost::asio::post(io, onResults);
+      });
+  scheduleRefresh();
+
+  // Reader thread
+  thread reader([&io, &child_stdout, &onOrigin, &shutdown, &resync, &publish]() {
+    string line;
+    while (getline(child_stdout, line)) {
+      double lat, lon;
+      if (sscanf(line.c_str(), "%lf %lf", &lat, &lon) == 2) {
+        boost::asio::post(io, [&onOrigin, lat, lon]() { onOrigin(lat, lon); });
       }
-      else {
-        for (auto& entry : entries) {
-          entry->distance = nullopt;
-        }
+      else if (line == "resync") {  // the UI missed a message
+        boost::asio::post(io, [&resync, &publish]() {
+            resync = true;
+            publish();
+            });
       }
     }
+    boost::asio::post(io, shutdown);
+  });
 
-    if (!stationChangeNeeded.load()) {
-      string json = entriesToJson(entries, location);
-      child_stdin << json << endl;
-    }
-  }
+  io.run();
+
+  // shutdown cleared running; the store wakes the sender to see it
+  position.store(position.load());
+  bluetooth.join();
 
+  session.stop();
   child_stdin.pipe().close();
   python_process.wait();
   reader.join();
 
   return 0;
 }
-
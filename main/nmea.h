@@ -0,0 +1,48 @@
+#pragma once
+#include <string_view>
+#include <optional>
+#include <chrono>
+#include <cstddef>
+
+using namespace std;
+
+// Highest rate the engine will emit at
+constexpr int MAX_NMEA_RATE_HZ = 10;
+
+// Position published by the tracker: ground velocity in m/s, the semi-major
+// axis of the 1-sigma error ellipse in meters and the east, north, velocity
+// east, velocity north covariance, as of time
+struct NavState {
+  double lat, lon;
+  double velocityEast, velocityNorth;
+  double error;
+  double covariance[4][4];
+  chrono::steady_clock::time_point time;
+};
+
+// Formats GGA, RMC, VTG and GSA for the latest NavState. Between tracker
+// updates the position is carried forward along the velocity, so the output
+// keeps moving at the full rate. Speed and course come from the tracker's
+// velocity, which it estimates over the whole bearing history. The sentences
+// are written into a fixed buffer inside the engine.
+class NmeaEngine {
+  public:
+    void update(const optional<NavState>& state) { nav = state; }
+
+    // The four sentences for the current time, valid until the next call
+    string_view sentences();
+
+  private:
+    void begin(const char* type);
+    void end();
+    void put(char c) { if (length < sizeof(buffer)) buffer[length++] = c; }
+    void put(const char* s) { while (*s) put(*s++); }
+    void putInt(long long value, int width);
+    void putFixed(double value, int decimals);
+    void putLatLon(double degrees, int degreeWidth, char positive, char negative);
+
+    optional<NavState> nav;
+    char buffer[512];
+    size_t length = 0;
+    size_t start = 0;
+};
@@ -0,0 +1,357 @@
+#include "sdr_session.h"
+#include "vorify.h"
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+using namespace std;
+
+optional<vor_bearing_t> calculateBearing(BearingEngine& engine);
+vector<optional<vor_bearing_t>> calculateBearings(BearingEngine& engine, const vector<double>& frequencies);
+
+// One slot in this many listens for an ident when one is still pending
+constexpr unsigned IDENT_EVERY = 4;
+
+// VOR idents repeat every 7-10 seconds; a full one must fit between silences
+constexpr auto IDENT_DWELL = chrono::seconds(20);
+
+// Wait before listening again for an ident that was not decoded, doubled on
+// every further failure up to IDENT_RETRY_MAX
+constexpr auto IDENT_RETRY = chrono::seconds(30);
+constexpr auto IDENT_RETRY_MAX = chrono::seconds(300);
+
+constexpr auto SETTLE_TIMEOUT = chrono::milliseconds(1000);
+
+SdrSession::SdrSession(int count) {
+  if (count <= 0) {
+    count = max(1, rtlDeviceCount());
+  }
+  cout << "Measuring with " << count << " receiver(s)" << endl;
+
+  for (int i = 0; i < count; ++i) {
+    receivers.push_back(make_unique<Receiver>(i));
+  }
+  for (auto& receiver : receivers) {
+    receiver->worker = thread([this, &receiver = *receiver]() { run(receiver); });
+  }
+}
+
+SdrSession::~SdrSession() {
+  stop();
+}
+
+void SdrSession::setStations(const vector<pair<string, double>>& newStations) {
+  lock_guard<mutex> lock(sessionMutex);
+
+  vector<Station> updated;
+  for (const auto& [id, frequency] : newStations) {
+    Station station{id, frequency};
+    auto it = find_if(stations.begin(), stations.end(), [&](const Station& s) {
+        return s.id == id && s.frequency == frequency;
+        });
+    if (it != stations.end()) {
+      station.identChecked = it->identChecked;
+      station.identFailures = it->identFailures;
+      station.identRetryAt = it->identRetryAt;
+      station.busy = it->busy;
+    }
+    updated.push_back(station);
+  }
+
+  stations.swap(updated);
+  planWindows();
+
+  for (auto& receiver : receivers) {
+    if (receiver->measuring.empty()) {
+      continue;
+    }
+    bool stillWanted = any_of(receiver->measuring.begin(), receiver->measuring.end(), [this](const auto& m) {
+        return any_of(stations.begin(), stations.end(), [&m](const Station& s) {
+            return s.id == m.first && s.frequency == m.second;
+            });
+        });
+    if (!stillWanted) {
+      cancel(*receiver);
+    }
+  }
+  stationsChanged.notify_all();
+}
+
+void SdrSession::setResultHandler(function<void()> handler) {
+  lock_guard<mutex> lock(sessionMutex);
+  resultHandler = move(handler);
+}
+
+// Abandons the receiver's current slot; sessionMutex must be held
+void SdrSession::cancel(Receiver& receiver) {
+  cout << "Cancelling measurement on receiver " << receiver.index << endl;
+  receiver.cancelled = true;
+  receiver.engine.cancel();
+}
+
+// Groups stations whose channels fit around one tuner centre. The centre
+// is kept off every member, since the RTL has a DC spike at 0 Hz.
+void SdrSession::planWindows() {
+  auto channel = [this](size_t i) {
+    return lround(stations[i].frequency * 1000000.0 / FSINT);
+  };
+
+  vector<size_t> order(stations.size());
+  iota(order.begin(), order.end(), 0);
+  sort(order.begin(), order.end(), [&](size_t a, size_t b) { return channel(a) < channel(b); });
+
+  windows.clear();
+  size_t first = 0;
+  while (first < order.size()) {
+    long low = channel(order[first]);
+    size_t last = first;
+    while (last + 1 < order.size() && channel(order[last + 1]) <= low + 2 * MAX_CHANNEL_BIN) {
+      ++last;
+    }
+
+    optional<long> center;
+    while (!center) {
+      long high = channel(order[last]);
+      long middle = (low + high) / 2;
+      for (long offset = 0; !center && offset <= MAX_CHANNEL_BIN; ++offset) {
+        for (long candidate : {middle - offset, middle + offset}) {
+          bool inRange = candidate >= high - MAX_CHANNEL_BIN && candidate <= low + MAX_CHANNEL_BIN;
+          bool occupied = any_of(order.begin() + first, order.begin() + last + 1, [&](size_t i) {
+              return channel(i) == candidate;
+              });
+          if (inRange && !occupied) {
+            center = candidate;
+            break;
+          }
+        }
+      }
+      if (!center) {
+        --last;
+      }
+    }
+
+    Window window{*center * FSINT / 1000000.0, {}};
+    window.members.assign(order.begin() + first, order.begin() + last + 1);
+    windows.push_back(window);
+    first = last + 1;
+  }
+}
+
+vector<SlotResult> SdrSession::poll() {
+  lock_guard<mutex> lock(sessionMutex);
+  vector<SlotResult> completed;
+  completed.swap(results);
+  return completed;
+}
+
+TuningStats SdrSession::stats() const {
+  lock_guard<mutex> lock(sessionMutex);
+  return tuning;
+}
+
+void SdrSession::stop() {
+  {
+    lock_guard<mutex> lock(sessionMutex);
+    if (!running) {
+      return;
+    }
+    running = false;
+    for (auto& receiver : receivers) {
+      receiver->cancelled = true;
+      receiver->engine.cancel();
+    }
+  }
+  stationsChanged.notify_all();
+  for (auto& receiver : receivers) {
+    if (receiver->worker.joinable()) {
+      receiver->worker.join();
+    }
+    receiver->engine.stop();
+  }
+}
+
+optional<SdrSession::Slot> SdrSession::nextSlot(Receiver& receiver) {
+  unique_lock<mutex> lock(sessionMutex);
+  stationsChanged.wait(lock, [this]() {
+      return !running || any_of(stations.begin(), stations.end(), [](const Station& s) { return !s.busy; });
+      });
+  if (!running) {
+    return nullopt;
+  }
+
+  if (++slotCount % IDENT_EVERY == 0) {
+    auto now = chrono::steady_clock::now();
+    for (size_t i = 0; i < stations.size(); ++i) {
+      auto& station = stations[(identCursor + i) % stations.size()];
+      if (!station.identChecked && !station.busy && now >= station.identRetryAt) {
+        station.busy = true;
+        identCursor = (identCursor + i + 1) % stations.size();
+        receiver.measuring = {{station.id, station.frequency}};
+        receiver.cancelled = false;
+        receiver.engine.resume();
+        return Slot{SlotResult::IDENT, {station}, station.frequency};
+      }
+    }
+  }
+
+  for (size_t i = 0; i < windows.size(); ++i) {
+    const auto& window = windows[(bearingCursor + i) % windows.size()];
+    Slot slot{SlotResult::BEARING, {}, window.center};
+    for (size_t member : window.members) {
+      if (!stations[member].busy) {
+        stations[member].busy = true;
+        slot.stations.push_back(stations[member]);
+        receiver.measuring.emplace_back(stations[member].id, stations[member].frequency);
+      }
+    }
+    if (!slot.stations.empty()) {
+      receiver.cancelled = false;
+      receiver.engine.resume();
+      bearingCursor = (bearingCursor + i + 1) % windows.size();
+      return slot;
+    }
+  }
+  return nullopt;
+}
+
+void SdrSession::finished(Receiver& receiver, const vector<SlotResult>& finishedResults) {
+  function<void()> handler;
+  {
+    lock_guard<mutex> lock(sessionMutex);
+    receiver.measuring.clear();
+    for (const auto& result : finishedResults) {
+      auto it = find_if(stations.begin(), stations.end(), [&](const Station& s) {
+          return s.id == result.id && s.frequency == result.frequency;
+          });
+      if (it == stations.end()) {
+        continue;
+      }
+      it->busy = false;
+
+      // Timed out, cancelled, not tuned or not the expected ident: listen
+      // again after a backoff. The owner decides when a station keeps
+      // sending someone else's ident.
+      if (result.kind == SlotResult::IDENT) {
+        if (result.ident && *result.ident == it->id) {
+          it->identChecked = true;
+        } else {
+          auto backoff = min(IDENT_RETRY * (1 << min(it->identFailures, 4)), IDENT_RETRY_MAX);
+          it->identRetryAt = chrono::steady_clock::now() + backoff;
+          it->identFailures++;
+          cout << (result.ident ? "Mismatched" : "No") << " ident decoded for " << it->id
+            << ", retrying in " << backoff.count() << " s" << endl;
+        }
+      }
+
+      if (!receiver.cancelled) {
+        results.push_back(result);
+        handler = resultHandler;
+      }
+    }
+    stationsChanged.notify_all();
+  }
+
+  if (handler) {
+    handler();
+  }
+}
+
+// Logs the latency of the retune the receiver just made
+void SdrSession::report(Receiver& receiver, double frequency) {
+  auto retune = receiver.engine.retuneLatency();
+  auto settle = receiver.engine.waitSettled(SETTLE_TIMEOUT);
+
+  lock_guard<mutex> lock(sessionMutex);
+  tuning.retunes++;
+  tuning.retuneTotal += retune;
+  tuning.retuneMax = max(tuning.retuneMax, retune);
+  if (settle) {
+    tuning.settles++;
+    tuning.settleTotal += *settle;
+    tuning.settleMax = max(tuning.settleMax, *settle);
+  }
+
+  cout << "Receiver " << receiver.index << " tuned " << frequency
+    << ": retune " << retune.count() / 1000.0 << " ms"
+    << " (avg " << tuning.retuneTotal.count() / 1000.0 / tuning.retunes
+    << ", max " << tuning.retuneMax.count() / 1000.0 << "), settle ";
+  if (settle) {
+    cout << settle->count() / 1000.0 << " ms";
+  } else {
+    cout << "timed out";
+  }
+  if (tuning.settles) {
+    cout << " (avg " << tuning.settleTotal.count() / 1000.0 / tuning.settles
+      << ", max " << tuning.settleMax.count() / 1000.0 << ")";
+  }
+  cout << endl;
+}
+
+vector<SlotResult> SdrSession::measure(Receiver& receiver, const Slot& slot) {
+  vector<SlotResult> slotResults;
+  vector<double> frequencies;
+  for (const auto& station : slot.stations) {
+    slotResults.push_back(SlotResult{slot.kind, station.id, station.frequency, nullopt, nullopt, {}});
+    if (find(frequencies.begin(), frequencies.end(), station.frequency) == frequencies.end()) {
+      frequencies.push_back(station.frequency);
+    }
+  }
+
+  // Shutting down: hand the stations back untouched
+  if (!running) {
+    return slotResults;
+  }
+
+  bool tuned = frequencies.size() == 1
+    ? receiver.engine.retune(frequencies[0])
+    : receiver.engine.tuneWindow(slot.center, frequencies);
+  if (!tuned) {
+    cerr << "Failed to tune receiver " << receiver.index << " to " << slot.center << '\n';
+  } else {
+    report(receiver, frequencies.size() == 1 ? frequencies[0] : slot.center);
+
+    if (receiver.cancelled || !running) {
+      // Stations left, or the session stopped, while tuning; finished()
+      // drops the results
+    } else if (slot.kind == SlotResult::IDENT) {
+      receiver.identDecoder.reset();
+      receiver.engine.attachIdentDecoder(&receiver.identDecoder);
+      auto deadline = chrono::steady_clock::now() + IDENT_DWELL;
+      // A '?' is a letter lost to noise or to a partial keying cycle; keep
+      // listening for the next repetition and report no decode otherwise
+      auto complete = [&receiver]() {
+        optional<string> ident = receiver.identDecoder.ident();
+        return ident && ident->find('?') == string::npos ? ident : nullopt;
+      };
+      while (!receiver.cancelled && chrono::steady_clock::now() < deadline && !complete()) {
+        this_thread::sleep_for(chrono::milliseconds(200));
+      }
+      receiver.engine.attachIdentDecoder(nullptr);
+      slotResults[0].ident = complete();
+    } else if (frequencies.size() == 1) {
+      optional<vor_bearing_t> bearing = calculateBearing(receiver.engine);
+      for (auto& result : slotResults) {
+        result.setBearing(bearing);
+      }
+    } else {
+      vector<optional<vor_bearing_t>> bearings = calculateBearings(receiver.engine, frequencies);
+      for (auto& result : slotResults) {
+        size_t i = find(frequencies.begin(), frequencies.end(), result.frequency) - frequencies.begin();
+        result.setBearing(bearings[i]);
+      }
+    }
+  }
+
+  auto now = chrono::steady_clock::now();
+  for (auto& result : slotResults) {
+    result.timestamp = now;
+  }
+  return slotResults;
+}
+
+void SdrSession::run(Receiver& receiver) {
+  while (optional<Slot> slot = nextSlot(receiver)) {
+    finished(receiver, measure(receiver, *slot));
+  }
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "bearing_engine.h"
+#include "ident_decoder.h"
+#include <string>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+using namespace std;
+
+struct SlotResult {
+  enum Kind { BEARING, IDENT } kind;
+  string id;
+  double frequency;
+  optional<double> bearing;
+  optional<string> ident;
+  chrono::steady_clock::time_point timestamp;
+  // Standard error of bearing in degrees, as the demodulator measured it
+  double error = 0;
+
+  void setBearing(const optional<vor_bearing_t>& measured) {
+    bearing = measured ? optional<double>(measured->bearing) : nullopt;
+    error = measured ? measured->error : 0;
+  }
+};
+
+struct TuningStats {
+  int retunes = 0;
+  chrono::microseconds retuneTotal{0};
+  chrono::microseconds retuneMax{0};
+  int settles = 0;
+  chrono::microseconds settleTotal{0};
+  chrono::microseconds settleMax{0};
+};
+
+// Keeps the SDRs open for the lifetime of main and hops them round-robin
+// over the stations in range. Stations whose frequencies fit in one tuner
+// bandwidth are grouped into a window and measured together through the
+// channelizer. Each receiver has its own worker thread and demodulator and
+// takes the next window no other receiver is measuring. Every
+// IDENT_EVERY-th slot is spent listening for the ident of a station that has
+// not been identified yet, retried with a backoff until its own ident is
+// decoded; the rest measure bearings. Results are collected until the main
+// loop polls them. A slot whose stations all leave the set is cancelled, and results
+// for stations that left are dropped.
+class SdrSession {
+  public:
+    // One receiver per RTL device when receivers is 0
+    explicit SdrSession(int receivers = 0);
+    ~SdrSession();
+
+    // Stations as (id, frequency in MHz); ident state is kept for survivors
+    void setStations(const vector<pair<string, double>>& stations);
+
+    // Called from a worker thread, without locks held, after each slot that
+    // produced results. It should only hand off to the owner's event loop.
+    void setResultHandler(function<void()> handler);
+
+    vector<SlotResult> poll();
+    TuningStats stats() const;
+    void stop();
+
+  private:
+    struct Receiver {
+      explicit Receiver(int index) : index(index), engine(index) {}
+      int index;
+      BearingEngine engine;
+      IdentDecoder identDecoder;
+      thread worker;
+
+      // (id, frequency) of the slot in progress, guarded by sessionMutex
+      vector<pair<string, double>> measuring;
+      atomic<bool> cancelled{false};
+    };
+
+    struct Station {
+      string id;
+      double frequency;
+      bool busy = false;
+
+      // Set once the station's own ident was decoded. Each failed or
+      // mismatched attempt doubles the wait before the next one.
+      bool identChecked = false;
+      int identFailures = 0;
+      chrono::steady_clock::time_point identRetryAt{};
+    };
+
+    // Stations measured together around one tuner centre frequency
+    struct Window {
+      double center;
+      vector<size_t> members;
+    };
+
+    struct Slot {
+      SlotResult::Kind kind;
+      vector<Station> stations;
+      double center;
+    };
+
+    void planWindows();
+    void run(Receiver& receiver);
+    optional<Slot> nextSlot(Receiver& receiver);
+    void finished(Receiver& receiver, const vector<SlotResult>& finishedResults);
+    void cancel(Receiver& receiver);
+    void report(Receiver& receiver, double frequency);
+    vector<SlotResult> measure(Receiver& receiver, const Slot& slot);
+
+    vector<unique_ptr<Receiver>> receivers;
+
+    mutable mutex sessionMutex;
+    condition_variable stationsChanged;
+    vector<Station> stations;
+    vector<Window> windows;
+    size_t bearingCursor = 0;
+    size_t identCursor = 0;
+    unsigned slotCount = 0;
+    vector<SlotResult> results;
+    function<void()> resultHandler;
+    TuningStats tuning;
+    atomic<bool> running{true};
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+using namespace std;
+
+// Single-writer slot that any number of threads can read without locking.
+// The writer bumps the sequence to odd, stores the value and bumps it back
+// to even; a reader copies the value and retries if the sequence moved or
+// was odd. The value is stored as relaxed atomic words, so a torn copy is
+// never undefined behaviour, only discarded. Readers never block the writer.
+//
+// Readers that run on a timer can also sleep until the next store instead
+// of polling for it. The wakeup uses a condition variable that the writer
+// only notifies, never locks, so a wakeup that races a reader going to sleep
+// can be missed. The reader then sleeps until its own deadline.
+template <typename T>
+class Seqlock {
+    static_assert(is_trivially_copyable_v<T>, "Seqlock values are copied bytewise");
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  public:
+    Seqlock() { store(T{}); }
+
+    // Only ever called from one thread
+    void store(const T& value) {
+      uint64_t words[WORDS] = {};
+      memcpy(words, &value, sizeof(T));
+
+      uint32_t s = sequence.load(memory_order_relaxed);
+      sequence.store(s + 1, memory_order_relaxed);
+      atomic_thread_fence(memory_order_release);
+      for (size_t i = 0; i < WORDS; ++i) {
+        data[i].store(words[i], memory_order_relaxed);
+      }
+      sequence.store(s + 2, memory_order_release);
+      stored.notify_all();
+    }
+
+    // The latest value and the sequence it was stored under
+    T load(uint32_t* version = nullptr) const {
+      uint64_t words[WORDS];
+      uint32_t before, after;
+      do {
+        before = sequence.load(memory_order_acquire);
+        for (size_t i = 0; i < WORDS; ++i) {
+          words[i] = data[i].load(memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = sequence.load(memory_order_relaxed);
+      } while (before != after || (before & 1));
+
+      T value;
+      memcpy(&value, words, sizeof(T));
+      if (version) {
+        *version = before;
+      }
+      return value;
+    }
+
+    // Sleeps until a store newer than version or until deadline
+    void waitUntil(uint32_t version, chrono::steady_clock::time_point deadline) const {
+      unique_lock<mutex> lock(wakeMutex);
+      stored.wait_until(lock, deadline, [this, version]() {
+          return sequence.load(memory_order_acquire) != version;
+          });
+    }
+
+  private:
+    atomic<uint32_t> sequence{0};
+    atomic<uint64_t> data[WORDS];
+    mutable mutex wakeMutex;
+    mutable condition_variable stored;
+};
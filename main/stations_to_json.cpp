@@ -1,51 +1,178 @@
-#include "entry.h"
-#include <sstream>
-#include <iomanip>
-#include <vector>
-#include <memory>
+#include "stations_to_json.h"
+#include <charconv>
+#include <cmath>
 
 using namespace std;
 
-string entriesToJson(const vector<shared_ptr<Entry>>& entries, const optional<Location>& location) {
-  ostringstream oss;
-  oss << "{ \"location\": ";
-  if (location.has_value()) {
-    oss << "{ \"lat\": " << location->lat << ", \"lon\": " << location->lon << " }, ";
+// Bearings older than this are shown as missing
+constexpr auto BEARING_SHOWN_FOR = chrono::seconds(17);
+
+// Decimals sent for each kind of value. Changes below them are not sent.
+constexpr int LOCATION_DECIMALS = 6;
+constexpr int BEARING_DECIMALS = 1;
+constexpr int DISTANCE_DECIMALS = 3;
+
+static optional<double> rounded(const optional<double>& value, int decimals) {
+  if (!value) {
+    return nullopt;
+  }
+  double scale = pow(10.0, decimals);
+  return round(*value * scale) / scale;
+}
+
+static optional<Location> rounded(const optional<Location>& location) {
+  if (!location) {
+    return nullopt;
   }
-  else {
-    oss << "null, ";
+  return Location{*rounded(location->lat, LOCATION_DECIMALS), *rounded(location->lon, LOCATION_DECIMALS)};
+}
+
+static optional<double> shownBearing(const EntryTable& entries, EntryHandle h, chrono::steady_clock::time_point now) {
+  const auto& bearing = entries.bearing[h];
+  if (!bearing || now - bearing->timestamp > BEARING_SHOWN_FOR) {
+    return nullopt;
   }
+  return rounded(bearing->value, BEARING_DECIMALS);
+}
+
+void UiStream::writeNumber(double value, int precision) {
+  char digits[32];
+  auto result = to_chars(digits, digits + sizeof(digits), value, chars_format::fixed, precision);
+  buffer.append(digits, result.ptr);
+}
 
+void UiStream::writeShortest(double value) {
+  char digits[32];
+  auto result = to_chars(digits, digits + sizeof(digits), value);
+  buffer.append(digits, result.ptr);
+}
+
+void UiStream::writeUnsigned(uint64_t value) {
+  char digits[24];
+  auto result = to_chars(digits, digits + sizeof(digits), value);
+  buffer.append(digits, result.ptr);
+}
+
+void UiStream::writeValue(const optional<double>& value, int precision) {
+  if (value) {
+    writeNumber(*value, precision);
+  } else {
+    buffer += "null";
+  }
+}
+
+void UiStream::writeLocation(const optional<Location>& location) {
+  if (!location) {
+    buffer += "null";
+    return;
+  }
+  buffer += "{\"lat\":";
+  writeNumber(location->lat, LOCATION_DECIMALS);
+  buffer += ",\"lon\":";
+  writeNumber(location->lon, LOCATION_DECIMALS);
+  buffer += '}';
+}
+
+void UiStream::snapshot(const EntryTable& entries, const optional<Location>& location) {
+  auto now = chrono::steady_clock::now();
+  lastSnapshot = now;
+  shownLocation = rounded(location);
+  shownOrder = entries.handles();
+
+  buffer += ",\"full\":true,\"location\":";
+  writeLocation(location);
+  buffer += ",\"stations\":[";
+  for (size_t i = 0; i < shownOrder.size(); ++i) {
+    EntryHandle h = shownOrder[i];
+    if (h >= shown.size()) {
+      shown.resize(h + 1);
+    }
+    shown[h] = {shownBearing(entries, h, now), rounded(entries.distance[h], DISTANCE_DECIMALS), entries.identified[h]};
+
+    if (i > 0) {
+      buffer += ',';
+    }
+    buffer += "{\"h\":";
+    writeUnsigned(h);
+    buffer += ",\"name\":\"";
+    buffer += entries.name[h];
+    buffer += "\",\"id\":\"";
+    buffer += entries.id[h];
+    buffer += "\",\"frequency\":";
+    writeShortest(entries.frequency[h]);
+    buffer += ",\"location\":";
+    writeLocation(Location{entries.lat[h], entries.lon[h]});
+    buffer += ",\"is_identified\":";
+    buffer += entries.identified[h] ? "true" : "false";
+    buffer += ",\"bearing\":";
+    writeValue(shown[h].bearing, BEARING_DECIMALS);
+    buffer += ",\"distance\":";
+    writeValue(shown[h].distance, DISTANCE_DECIMALS);
+    buffer += '}';
+  }
+  buffer += "]}";
+}
+
+string_view UiStream::update(const EntryTable& entries, const optional<Location>& location, bool full) {
   auto now = chrono::steady_clock::now();
+  buffer.clear();
+  buffer += "{\"seq\":";
+  writeUnsigned(seq + 1);
 
-  oss << "\"stations\": [";
-  for (size_t i = 0; i < entries.size(); ++i) {
-    const auto& e = entries[i];
-    oss << "{";
-    oss << "\"name\":\"" << e->name << "\",";
-    oss << "\"id\":\"" << e->id << "\",";
-    oss << "\"frequency\":" << e->frequency << ",";
-    oss << "\"location\":{\"lat\":\"" << e->location.lat << "\",\"lon\":\"" << e->location.lon << "\"},";
-    oss << "\"is_identified\":" << (e->is_identified ? "true" : "false") << ",";
-    if (e->bearing.has_value() && 
-         chrono::duration_cast<chrono::seconds>(now - e->bearing->timestamp).count() <= 17) {
-      auto seconds = chrono::duration_cast<chrono::duration<double>>(
-          e->bearing->timestamp.time_since_epoch()).count();
-      oss << "\"bearing\":{\"value\":" << e->bearing->value << ",\"timestamp\":" << fixed << setprecision(6) << seconds << "},";
-    } else {
-      oss << "\"bearing\":null,";
+  if (full || seq == 0 || now - lastSnapshot >= UI_SNAPSHOT_INTERVAL || entries.handles() != shownOrder) {
+    ++seq;
+    snapshot(entries, location);
+    return buffer;
+  }
+  for (EntryHandle h : shownOrder) {
+    if (entries.identified[h] != shown[h].identified) {
+      ++seq;
+      snapshot(entries, location);
+      return buffer;
     }
-    if (e->distance.has_value()) {
-      oss << "\"distance\":" << fixed << setprecision(3) << e->distance.value();
-    } else {
-      oss << "\"distance\":null";
+  }
+
+  size_t header = buffer.size();
+  if (rounded(location) != shownLocation) {
+    shownLocation = rounded(location);
+    buffer += ",\"location\":";
+    writeLocation(location);
+  }
+
+  bool first = true;
+  for (EntryHandle h : shownOrder) {
+    optional<double> bearing = shownBearing(entries, h, now);
+    optional<double> distance = rounded(entries.distance[h], DISTANCE_DECIMALS);
+    bool bearingChanged = bearing != shown[h].bearing;
+    bool distanceChanged = distance != shown[h].distance;
+    if (!bearingChanged && !distanceChanged) {
+      continue;
     }
-    oss << "}";
-    if (i < entries.size() - 1) {
-      oss << ",";
+
+    buffer += first ? ",\"stations\":[" : ",";
+    first = false;
+    buffer += "{\"h\":";
+    writeUnsigned(h);
+    if (bearingChanged) {
+      shown[h].bearing = bearing;
+      buffer += ",\"bearing\":";
+      writeValue(bearing, BEARING_DECIMALS);
+    }
+    if (distanceChanged) {
+      shown[h].distance = distance;
+      buffer += ",\"distance\":";
+      writeValue(distance, DISTANCE_DECIMALS);
     }
+    buffer += '}';
+  }
+  if (!first) {
+    buffer += ']';
   }
-  oss << "] }";
 
-  return oss.str();
+  if (buffer.size() == header) {
+    return {};
+  }
+  ++seq;
+  buffer += '}';
+  return buffer;
 }
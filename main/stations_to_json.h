@@ -0,0 +1,51 @@
+#pragma once
+#include "entry.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+// How often a full snapshot is sent even when nothing forced one
+constexpr auto UI_SNAPSHOT_INTERVAL = chrono::seconds(10);
+
+// Serializes the station table for ui.py as one JSON object per line.
+//
+// A snapshot ({"seq":N,"full":true,...}) lists every station in display
+// order keyed by its handle. Other messages only carry what changed since
+// the previous one: the location, and each station's bearing or distance as
+// {"h":handle,...}. A change in the set, its order or ident state sends a
+// snapshot instead. seq goes up by one per message, so the UI can tell it
+// missed one and ask for a snapshot. Messages are built in a buffer that is
+// reused from one call to the next.
+class UiStream {
+  public:
+    // The next message, or an empty view when nothing changed. full forces
+    // a snapshot. The view is valid until the next call.
+    string_view update(const EntryTable& entries, const optional<Location>& location, bool full = false);
+
+  private:
+    // What the UI was last sent for one station
+    struct Shown {
+      optional<double> bearing;
+      optional<double> distance;
+      bool identified;
+    };
+
+    void snapshot(const EntryTable& entries, const optional<Location>& location);
+    void writeLocation(const optional<Location>& location);
+    void writeValue(const optional<double>& value, int precision);
+    void writeNumber(double value, int precision);
+    void writeShortest(double value);
+    void writeUnsigned(uint64_t value);
+
+    string buffer;
+    uint64_t seq = 0;
+    chrono::steady_clock::time_point lastSnapshot;
+    optional<Location> shownLocation;
+    vector<EntryHandle> shownOrder;
+    vector<Shown> shown;  // indexed by handle
+};
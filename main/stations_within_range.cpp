@@ -1,57 +1,54 @@
 #include "entry.h"
+#include "station_db.h"
 #include <vector>
-#include <string>
-#include <sstream>
-#include <iostream>
-#include <cstdio>
+#include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
-#include <memory>
 
 using namespace std;
 
-vector<shared_ptr<Entry>> getStationsWithinRange(const double lat, const double lon, const int range) {
-  string cmd = "../stations-within-range/stations-within-range " + to_string(lat) + " " + to_string(lon) + " " + to_string(range) + " ../VOR.CSV" ;
-  vector<shared_ptr<Entry>> entries;
+// The compiled station database, mapped once for the life of main
+static const StationDB& stationDB() {
+  static StationDB db("../VOR.bin");
+  return db;
+}
 
-  FILE* pipe = popen(cmd.c_str(), "r");
-  if (!pipe) {
-    perror("popen failed");
-    return entries;
+// Brings entries in line with the stations within range of (lat, lon). Only
+// added and removed stations are touched; survivors keep their ident and
+// bearing state. Entries stay ordered nearest first. Returns whether any
+// station was added or removed.
+bool updateStationsWithinRange(EntryTable& entries, double lat, double lon, int range) {
+  const StationDB& db = stationDB();
+  auto found = db.within(lat, lon, range);
+
+  unordered_map<uint32_t, size_t> rank;
+  for (size_t i = 0; i < found.size(); ++i) {
+    rank.emplace(found[i].first, i);
   }
 
-  char buffer[256];
-  while (fgets(buffer, sizeof(buffer), pipe)) {
-    istringstream iss(buffer);
-    Entry e;
-    if (iss >> e.name >> e.id >> e.location.lat >> e.location.lon >> e.frequency) {
-      auto entry = make_shared<Entry>();
-      entry->name = e.name;
-      entry->id = e.id;
-      entry->location = e.location;
-      entry->frequency = e.frequency;
-      entries.push_back(entry);
+  bool changed = false;
+  unordered_set<uint32_t> present;
+  vector<EntryHandle> current = entries.handles();
+  for (EntryHandle h : current) {
+    if (rank.count(entries.record[h])) {
+      present.insert(entries.record[h]);
     } else {
-      cerr << "Skipping malformed line: " << buffer;
+      entries.remove(h);
+      changed = true;
     }
   }
 
-  pclose(pipe);
-  return entries;
-}
-
-void updateStationsWithinRange(vector<shared_ptr<Entry>>& entries1, double lat, double lon, int range) {
-  vector<shared_ptr<Entry>> entries2 = getStationsWithinRange(lat, lon, range);
-
-  for (auto& newEntry : entries2) {
-    auto it = find_if(entries1.begin(), entries1.end(), [&](const shared_ptr<Entry>& e) {
-        return e->id == newEntry->id && e->frequency == newEntry->frequency;
-        });
-
-    if (it != entries1.end()) {
-      newEntry->is_identified = (*it)->is_identified;
-      newEntry->bearing = (*it)->bearing;
+  for (const auto& [i, distance] : found) {
+    if (present.count(i)) {
+      continue;
     }
+    const StationRecord& s = db[i];
+    entries.add(i, db.str(s.name), db.str(s.id), s.freq_khz / 1000.0, Location{s.lat, s.lon});
+    changed = true;
   }
 
-  entries1.swap(entries2);
+  entries.sort([&entries, &rank](EntryHandle a, EntryHandle b) {
+      return rank[entries.record[a]] < rank[entries.record[b]];
+      });
+  return changed;
 }
@@ -0,0 +1,89 @@
+#include "station_csv.h"
+#include "station_db.h"
+#include "kd_tree.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstring>
+
+// Interns strings into the database's string table
+class StringTable {
+  public:
+    uint32_t add(const std::string& s) {
+      auto [it, inserted] = offsets.emplace(s, data.size());
+      if (inserted) {
+        data.insert(data.end(), s.begin(), s.end());
+        data.push_back('\0');
+      }
+      return it->second;
+    }
+    const std::vector<char>& bytes() const { return data; }
+
+  private:
+    std::map<std::string, uint32_t> offsets;
+    std::vector<char> data;
+};
+
+int main(int argc, char* argv[]) {
+  // Usage: ./compile-stations <csv_file> <db_file>
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <csv_file> <db_file>\n";
+    return 1;
+  }
+
+  auto stations = readCSV(argv[1]);
+  if (stations.empty()) {
+    std::cerr << "No stations read from " << argv[1] << "\n";
+    return 1;
+  }
+
+  StringTable strings;
+  std::vector<StationRecord> records;
+  for (const auto& s : stations) {
+    StationRecord r;
+    toUnitVector(s.lat, s.lon, r.xyz);
+    r.lat = s.lat;
+    r.lon = s.lon;
+    r.elev = s.elev;
+    r.decl = s.decl;
+    r.freq_khz = (uint32_t)std::lround(s.freq * 1000);
+    r.type = strings.add(s.type);
+    r.country = strings.add(s.country);
+    r.name = strings.add(s.name);
+    r.id = strings.add(s.id);
+    r.mft = strings.add(s.mft);
+    r.ref = strings.add(s.ref);
+    r.unit = strings.add(s.unit);
+    r.chan = strings.add(s.chan);
+    r.north = strings.add(s.north);
+    r.range = strings.add(s.range);
+    r.kmm = strings.add(s.kmm);
+    records.push_back(r);
+  }
+  kdBuild(records.data(), 0, records.size());
+
+  StationDBHeader header;
+  memcpy(header.magic, STATION_DB_MAGIC, sizeof(header.magic));
+  header.version = STATION_DB_VERSION;
+  header.record_size = sizeof(StationRecord);
+  header.count = records.size();
+  header.strings_size = strings.bytes().size();
+
+  // Written beside the target and renamed, so readers never map a partial file
+  std::string tmp = std::string(argv[2]) + ".tmp";
+  std::ofstream out(tmp, std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(StationRecord));
+  out.write(strings.bytes().data(), strings.bytes().size());
+  out.close();
+  if (!out || std::rename(tmp.c_str(), argv[2]) != 0) {
+    std::cerr << "Failed to write " << argv[2] << "\n";
+    return 1;
+  }
+
+  std::cout << "Compiled " << records.size() << " stations, " << strings.bytes().size() << " bytes of strings\n";
+  return 0;
+}
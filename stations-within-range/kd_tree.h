@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Implicit kd-tree over points that carry a unit vector xyz[3] on the sphere.
+// Chord length grows with great-circle distance, so "within R km" is a ball
+// query in 3D with no special cases at the poles or the antimeridian. The
+// points themselves are permuted so every subtree is a contiguous range
+// whose middle element is the split; there are no pointers, so the same
+// layout works in memory and in a compiled database file.
+
+constexpr double EARTH_RADIUS_KM = 6371.0;
+
+inline void toUnitVector(double lat, double lon, double xyz[3]) {
+  double phi = lat * M_PI / 180.0;
+  double lambda = lon * M_PI / 180.0;
+  xyz[0] = cos(phi) * cos(lambda);
+  xyz[1] = cos(phi) * sin(lambda);
+  xyz[2] = sin(phi);
+}
+
+template <typename Point>
+void kdBuild(Point* points, size_t begin, size_t end, int axis = 0) {
+  if (end - begin <= 1) {
+    return;
+  }
+  size_t mid = begin + (end - begin) / 2;
+  std::nth_element(points + begin, points + mid, points + end,
+      [axis](const Point& a, const Point& b) { return a.xyz[axis] < b.xyz[axis]; });
+  kdBuild(points, begin, mid, (axis + 1) % 3);
+  kdBuild(points, mid + 1, end, (axis + 1) % 3);
+}
+
+// Only descends into ranges whose slab reaches the ball
+template <typename Point>
+void kdSearch(const Point* points, size_t begin, size_t end, int axis, const double q[3], double max_chord2,
+    std::vector<std::pair<size_t, double>>& found)
+{
+  if (begin >= end) {
+    return;
+  }
+  size_t mid = begin + (end - begin) / 2;
+  const Point& point = points[mid];
+
+  double dx = point.xyz[0] - q[0], dy = point.xyz[1] - q[1], dz = point.xyz[2] - q[2];
+  double chord2 = dx * dx + dy * dy + dz * dz;
+  if (chord2 <= max_chord2) {
+    found.emplace_back(mid, 2 * EARTH_RADIUS_KM * asin(std::min(1.0, sqrt(chord2) / 2)));
+  }
+
+  double diff = q[axis] - point.xyz[axis];
+  int next = (axis + 1) % 3;
+  if (diff < 0) {
+    kdSearch(points, begin, mid, next, q, max_chord2, found);
+    if (diff * diff <= max_chord2) {
+      kdSearch(points, mid + 1, end, next, q, max_chord2, found);
+    }
+  } else {
+    kdSearch(points, mid + 1, end, next, q, max_chord2, found);
+    if (diff * diff <= max_chord2) {
+      kdSearch(points, begin, mid, next, q, max_chord2, found);
+    }
+  }
+}
+
+// Points within range_km of (lat, lon) as (position in points, distance in
+// km), nearest first. Distances are on the same sphere as haversine.
+template <typename Point>
+std::vector<std::pair<size_t, double>> kdWithin(const Point* points, size_t count, double lat, double lon, double range_km) {
+  std::vector<std::pair<size_t, double>> found;
+  if (range_km < 0) {
+    return found;
+  }
+
+  double q[3];
+  toUnitVector(lat, lon, q);
+  double angle = std::min(range_km / EARTH_RADIUS_KM, M_PI);
+  double max_chord = 2 * sin(angle / 2);
+  kdSearch(points, 0, count, 0, q, max_chord * max_chord, found);
+
+  std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+      return a.second < b.second || (a.second == b.second && a.first < b.first);
+      });
+  return found;
+}
@@ -0,0 +1,46 @@
+#include "station_csv.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+// Parse the CSV and return a vector of stations
+std::vector<VORStation> readCSV(const std::string& filename) {
+  std::ifstream file(filename);
+  std::vector<VORStation> stations;
+
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file: " << filename << "\n";
+    return stations;
+  }
+
+  std::string line;
+  std::getline(file, line); // Skip header
+
+  // CSV file columns are "type, country, name, id, lat, lon, elev, mft, ref, freq, unit, chan, decl, north, range, kmm"
+  while (std::getline(file, line)) {
+    std::stringstream ss(line);
+    std::string token;
+    VORStation station;
+
+    std::getline(ss, station.type, ',');
+    std::getline(ss, station.country, ',');
+    std::getline(ss, station.name, ',');
+    std::getline(ss, station.id, ',');
+    std::getline(ss, token, ','); station.lat = std::stod(token);
+    std::getline(ss, token, ','); station.lon = std::stod(token);
+    std::getline(ss, token, ','); station.elev = std::stod(token);
+    std::getline(ss, station.mft, ',');
+    std::getline(ss, station.ref, ',');
+    std::getline(ss, token, ','); station.freq = std::stod(token);
+    std::getline(ss, station.unit, ',');
+    std::getline(ss, station.chan, ',');
+    std::getline(ss, token, ','); station.decl = std::stod(token);
+    std::getline(ss, station.north, ',');
+    std::getline(ss, station.range, ',');
+    std::getline(ss, station.kmm, ',');
+
+    stations.push_back(station);
+  }
+
+  return stations;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Structure to store VOR station data
+struct VORStation {
+  std::string type;
+  std::string country;
+  std::string name;
+  std::string id;
+  double lat;
+  double lon;
+  double elev;
+  std::string mft;
+  std::string ref;
+  double freq;
+  std::string unit;
+  std::string chan;
+  double decl;
+  std::string north;
+  std::string range;
+  std::string kmm;
+  double distance;
+};
+
+// Parse the CSV and return a vector of stations
+std::vector<VORStation> readCSV(const std::string& filename);
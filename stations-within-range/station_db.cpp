@@ -0,0 +1,57 @@
+#include "station_db.h"
+#include "kd_tree.h"
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+StationDB::StationDB(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Failed to open station database: " << path << "\n";
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(StationDBHeader)) {
+    std::cerr << "Station database too short: " << path << "\n";
+    close(fd);
+    return;
+  }
+  mapSize = st.st_size;
+  map = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::cerr << "Failed to map station database: " << path << "\n";
+    map = nullptr;
+    return;
+  }
+
+  const auto* header = static_cast<const StationDBHeader*>(map);
+  const char* base = static_cast<const char*>(map);
+  size_t expected = sizeof(StationDBHeader) + (size_t)header->count * sizeof(StationRecord) + header->strings_size;
+  if (memcmp(header->magic, STATION_DB_MAGIC, sizeof(STATION_DB_MAGIC)) != 0
+      || header->version != STATION_DB_VERSION
+      || header->record_size != sizeof(StationRecord)
+      || expected != mapSize
+      || header->strings_size == 0 || base[mapSize - 1] != '\0') {
+    std::cerr << "Not a version " << STATION_DB_VERSION << " station database: " << path << "\n";
+    return;
+  }
+
+  count = header->count;
+  records = reinterpret_cast<const StationRecord*>(base + sizeof(StationDBHeader));
+  strings = base + sizeof(StationDBHeader) + count * sizeof(StationRecord);
+}
+
+StationDB::~StationDB() {
+  if (map) {
+    munmap(map, mapSize);
+  }
+}
+
+std::vector<std::pair<size_t, double>> StationDB::within(double lat, double lon, double range_km) const {
+  return kdWithin(records, count, lat, lon, range_km);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+// Compiled station database, written by compile-stations from VOR.CSV.
+//
+// Layout: a StationDBHeader, then count fixed-size StationRecords, then a
+// table of NUL-terminated strings. Each distinct string is stored once and
+// records refer to it by offset. Records are stored in kd-tree order (see
+// kd_tree.h), so range queries run straight off the mapped file. All fields
+// are little-endian. Bump STATION_DB_VERSION on any layout change.
+
+constexpr char STATION_DB_MAGIC[8] = {'V', 'O', 'R', 'D', 'B', '\n', 0, 0};
+constexpr uint32_t STATION_DB_VERSION = 1;
+
+struct StationDBHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t count;
+  uint32_t strings_size;
+};
+
+struct StationRecord {
+  double xyz[3];     // unit vector on the sphere, for the kd-tree
+  double lat;
+  double lon;
+  float elev;
+  float decl;
+  uint32_t freq_khz;
+  // Offsets into the string table
+  uint32_t type, country, name, id, mft, ref, unit, chan, north, range, kmm;
+};
+
+static_assert(sizeof(StationDBHeader) == 24, "StationDBHeader layout changed");
+static_assert(sizeof(StationRecord) == 96, "StationRecord layout changed");
+
+// Read-only view of a compiled database. The file is mapped shared, so
+// every process using it reads the same page cache pages.
+class StationDB {
+  public:
+    // Maps path; on failure prints why and is left empty
+    explicit StationDB(const std::string& path);
+    ~StationDB();
+    StationDB(const StationDB&) = delete;
+    StationDB& operator=(const StationDB&) = delete;
+
+    bool ok() const { return records != nullptr; }
+    size_t size() const { return count; }
+    const StationRecord& operator[](size_t i) const { return records[i]; }
+    const char* str(uint32_t offset) const { return strings + offset; }
+
+    // Records within range_km of (lat, lon) as (record, distance in km),
+    // nearest first
+    std::vector<std::pair<size_t, double>> within(double lat, double lon, double range_km) const;
+
+  private:
+    void* map = nullptr;
+    size_t mapSize = 0;
+    const StationRecord* records = nullptr;
+    size_t count = 0;
+    const char* strings = nullptr;
+};
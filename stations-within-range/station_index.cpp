@@ -0,0 +1,21 @@
+#include "station_index.h"
+#include "kd_tree.h"
+
+StationIndex::StationIndex(const std::vector<std::pair<double, double>>& positions) {
+  nodes.reserve(positions.size());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    Node node;
+    toUnitVector(positions[i].first, positions[i].second, node.xyz);
+    node.station = i;
+    nodes.push_back(node);
+  }
+  kdBuild(nodes.data(), 0, nodes.size());
+}
+
+std::vector<std::pair<size_t, double>> StationIndex::within(double lat, double lon, double range_km) const {
+  auto found = kdWithin(nodes.data(), nodes.size(), lat, lon, range_km);
+  for (auto& hit : found) {
+    hit.first = nodes[hit.first].station;
+  }
+  return found;
+}
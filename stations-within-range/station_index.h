@@ -0,0 +1,26 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+// In-memory kd-tree over station positions, for stations that are not in
+// a compiled database. See kd_tree.h for the layout.
+class StationIndex {
+  public:
+    StationIndex() = default;
+
+    // positions[i] is (lat, lon) of station i in degrees
+    explicit StationIndex(const std::vector<std::pair<double, double>>& positions);
+
+    // Stations within range_km of (lat, lon) as (station, distance in km),
+    // nearest first
+    std::vector<std::pair<size_t, double>> within(double lat, double lon, double range_km) const;
+
+  private:
+    struct Node {
+      double xyz[3];
+      size_t station;
+    };
+
+    std::vector<Node> nodes;
+};
@@ -15,7 +15,9 @@ database_path = os.path.join(script_directory, "offline_tiles.db")
 class VORApp:
     def __init__(self, root):
         self.root = root
-        self.vor_data = []
+        self.vor_data = {}
+        self.last_seq = 0
+        self.synced = False
         self.current_location = None
         self.location_history = []
         self.origin_location = None
@@ -171,7 +173,7 @@ class VORApp:
         self.tree.bind("<ButtonPress-1>", on_button_press)
         self.tree.bind("<B1-Motion>", on_mouse_drag)
 
-    def populate_table(self):
+    def update_status(self):
         if self.current_location and "lat" in self.current_location and "lon" in self.current_location:
             lat = self.current_location["lat"]
             lon = self.current_location["lon"]
@@ -194,10 +196,18 @@ class VORApp:
                 self.location_label.config(text="Not enough stations in range. Pick origin again")
                 self.start_flashing(self.change_origin_button)
 
-
+    def populate_table(self):
+        self.update_status()
         self.tree.delete(*self.tree.get_children())
-        for row in self.vor_data:
-            self.tree.insert("", tk.END, values=row)
+        for handle, row in self.vor_data.items():
+            self.tree.insert("", tk.END, iid=handle, values=row)
+
+    def update_rows(self, handles):
+        self.update_status()
+        for handle in handles:
+            row = self.vor_data.get(handle)
+            if row is not None and self.tree.exists(handle):
+                self.tree.item(handle, values=row)
 
     def empty_data(self):
         lat = self.origin_location["lat"]
@@ -206,27 +216,60 @@ class VORApp:
             
         self.tree.delete(*self.tree.get_children())
 
+    @staticmethod
+    def shown(value):
+        return "" if value is None else value
+
+    # Messages are either a full snapshot of the stations keyed by handle, or
+    # only the fields that changed since the previous message. After a gap
+    # in seq the deltas are ignored until the snapshot asked for arrives.
     def update_data(self, json_data):
         try:
             parsed = json.loads(json_data)
-            self.current_location = parsed.get("location")
-            if self.current_location is not None:
-              self.location_history.append((self.current_location["lat"], self.current_location["lon"]))
-            stations = parsed.get("stations", [])
-
-            self.vor_data = [
-                (
-                    item.get("name", ""),
-                    item.get("id", ""),
-                    item.get("frequency", ""),
-                    item.get("bearing", {}).get("value", "") if item.get("bearing") else "",
-                    item.get("distance", "") if item.get("distance") else ""
-                )
-                for item in stations
-            ]
+            seq = parsed["seq"]
+            full = parsed.get("full", False)
+            if not full and (not self.synced or seq != self.last_seq + 1):
+                if self.synced:
+                    self.synced = False
+                    print("resync", flush=True)
+                return
+            self.synced = True
+            self.last_seq = seq
+
+            if "location" in parsed:
+                self.current_location = parsed["location"]
+                if self.current_location is not None:
+                  self.location_history.append((self.current_location["lat"], self.current_location["lon"]))
+
+            if full:
+                self.vor_data = {
+                    str(item["h"]): [
+                        item.get("name", ""),
+                        item.get("id", ""),
+                        item.get("frequency", ""),
+                        self.shown(item.get("bearing")),
+                        self.shown(item.get("distance")),
+                    ]
+                    for item in parsed.get("stations", [])
+                }
+            else:
+                changed = []
+                for item in parsed.get("stations", []):
+                    row = self.vor_data.get(str(item["h"]))
+                    if row is None:
+                        continue
+                    if "bearing" in item:
+                        row[3] = self.shown(item["bearing"])
+                    if "distance" in item:
+                        row[4] = self.shown(item["distance"])
+                    changed.append(str(item["h"]))
+
             if self.show_marks:
               self.update_marks()
-            self.root.after(0, self.populate_table)
+            if full:
+                self.root.after(0, self.populate_table)
+            else:
+                self.root.after(0, self.update_rows, changed)
         except Exception as e:
             print(f"[Error parsing JSON]: {e}", file=sys.stderr)
 
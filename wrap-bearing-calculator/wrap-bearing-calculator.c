@@ -7,15 +7,74 @@
 #include <signal.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include "consensus.h"
 
 #define MAX_LINE_LEN 256
-#define MAX_DOUBLES 5
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <executable> [args...]\n", argv[0]);
+// Defaults for -t and -c
+#define DEADLINE 10.0      // seconds
+#define CONFIDENCE 0.5     // degrees, half-width of the 95% interval
+
+// Past the deadline an estimate is still printed if its interval is within
+// this many degrees; anything wider is no bearing at all
+#define MAX_CONFIDENCE 5.0
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// A reading is a line holding just a bearing, optionally followed by the
+// quality figures vorify -q prints; other output is ignored
+static int parseReading(const char *line, double *bearing, double *error) {
+    int used = 0;
+    if (sscanf(line, " %lf%n", bearing, &used) != 1) {
+        return 0;
+    }
+    line += used;
+    *error = 0;
+    if (sscanf(line, " err %lf", error) == 1) {
         return 1;
     }
+    while (*line == ' ' || *line == '\n' || *line == '\r') {
+        line++;
+    }
+    return *line == '\0';
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-t deadline] [-c confidence] <executable> [args...]\n\n", name);
+    fprintf(stderr, "Prints the consensus bearing of the readings the executable prints and the\n");
+    fprintf(stderr, "half-width of its 95%% confidence interval, both in degrees. Stops once the\n");
+    fprintf(stderr, "interval is within confidence (default %.1f) or at deadline seconds (default %.0f).\n",
+            CONFIDENCE, DEADLINE);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    double deadline = DEADLINE, target = CONFIDENCE;
+    int opt;
+
+    // '+' stops at the executable, so its own options are passed through
+    while ((opt = getopt(argc, argv, "+t:c:h")) != -1) {
+        switch (opt) {
+            case 't':
+                deadline = atof(optarg);
+                break;
+            case 'c':
+                target = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+    }
+    argv += optind - 1;
 
     int pipefd[2];
     if (pipe(pipefd) == -1) {
@@ -49,49 +108,66 @@ int main(int argc, char *argv[]) {
     // Parent process
     close(pipefd[1]); // Close write end
 
-    FILE *fp = fdopen(pipefd[0], "r");
-    if (!fp) {
-        perror("fdopen failed");
-        kill(pid, SIGKILL);
-        close(pipefd[0]);
-        return 1;
-    }
-
     char line[MAX_LINE_LEN];
-    double first_value = 0.0;
-    double value;
-    char extra[MAX_LINE_LEN];
-    bool first_assigned = false;
-    int count = 0;
-
-    while (fgets(line, sizeof(line), fp) != NULL && count < MAX_DOUBLES) {
-        if (sscanf(line, " %lf %s", &value, extra) == 1) {
-            if (!first_assigned) {
-                first_value = value;
-                first_assigned = true;
-            } else {
-                if (value != first_value) {
-                    fprintf(stderr, "Mismatch: got %f but expected %f\n", value, first_value);
-                    kill(pid, SIGTERM);
-                    waitpid(pid, NULL, 0);
-                    fclose(fp);
-                    return 1;
+    size_t length = 0;
+    consensus_t readings;
+    consensus_result_t result;
+    bool estimated = false, done = false;
+    double end = now() + deadline;
+
+    consensusInit(&readings);
+    while (!done) {
+        int timeout = (int)((end - now()) * 1000);
+        struct pollfd pfd = { pipefd[0], POLLIN, 0 };
+        if (timeout <= 0 || poll(&pfd, 1, timeout) <= 0) {
+            break;
+        }
+
+        ssize_t got = read(pipefd[0], line + length, sizeof(line) - 1 - length);
+        if (got <= 0) {
+            break;
+        }
+        length += got;
+
+        // Handle every complete line; a line longer than the buffer is cut
+        char *start = line, *newline;
+        line[length] = '\0';
+        while ((newline = strchr(start, '\n')) || (start == line && length == sizeof(line) - 1)) {
+            if (newline) {
+                *newline = '\0';
+            }
+            double bearing, error;
+            if (parseReading(start, &bearing, &error)) {
+                consensusAdd(&readings, bearing, error);
+                estimated = consensusEstimate(&readings, &result);
+                if (estimated && result.confidence <= target) {
+                    done = true;
+                    break;
                 }
             }
-            count++;
+            start = newline ? newline + 1 : line + length;
         }
+        length -= start - line;
+        memmove(line, start, length);
     }
 
     // Kill child process (in case it’s still running)
     kill(pid, SIGTERM);
     waitpid(pid, NULL, 0);
-    fclose(fp);
+    close(pipefd[0]);
 
-    if (!first_assigned) {
+    if (!estimated) {
         fprintf(stderr, "No bearing found\n");
         return 1;
     }
+    if (result.trimmed) {
+        fprintf(stderr, "Trimmed %d of %d readings as outliers\n", result.trimmed, result.used + result.trimmed);
+    }
+    if (!done && result.confidence > MAX_CONFIDENCE) {
+        fprintf(stderr, "No consensus: %f +- %f from %d readings\n", result.bearing, result.confidence, result.used);
+        return 1;
+    }
 
-    printf("%f\n", first_value);
+    printf("%f %f\n", result.bearing, result.confidence);
     return 0;
-}
\ No newline at end of file
+}